@@ -1,12 +1,187 @@
 #pragma once
 
 #include "cinder/gl/gl.h"
+#include "cinder/AxisAlignedBox.h"
+#include "cinder/Filesystem.h"
 #include "cinder/Log.h"
+#include "cinder/Quaternion.h"
+#include "cinder/Sphere.h"
+#include "cinder/Timer.h"
 
 #include "openvr.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+
+//! Define to 1 to compile in motion-to-photon latency tracking (see hmd::LatencyTracker). When 0, no tracking code is generated.
+#ifndef CINDER_VIVE_LATENCY_TRACKING
+	#define CINDER_VIVE_LATENCY_TRACKING 0
+#endif
+
 namespace hmd {
+	//! Non-owning reference to a callable, for callbacks that are only invoked during the call they are passed to.
+	//! Unlike std::function it never allocates, whatever the size of the lambda or std::bind expression it refers to.
+	//! Plain functions and function pointers are stored by value, since they cannot be referred to through a void pointer.
+	template<typename Signature>
+	class FunctionRef;
+
+	template<typename Ret, typename... Args>
+	class FunctionRef<Ret( Args... )> {
+	public:
+		FunctionRef( Ret ( *function )( Args... ) )
+			: mInvoke( []( Target target, Args... args ) -> Ret {
+				return target.function( std::forward<Args>( args )... );
+			} )
+		{
+			mTarget.function = function;
+		}
+
+		template<typename Callable, typename = typename std::enable_if<! std::is_same<typename std::decay<Callable>::type, FunctionRef>::value
+			&& ! std::is_function<typename std::remove_reference<Callable>::type>::value
+			&& ! std::is_pointer<typename std::decay<Callable>::type>::value>::type>
+		FunctionRef( Callable && callable )
+			: mInvoke( []( Target target, Args... args ) -> Ret {
+				return ( *static_cast<typename std::remove_reference<Callable>::type *>( target.callable ) )( std::forward<Args>( args )... );
+			} )
+		{
+			mTarget.callable = const_cast<void *>( static_cast<const void *>( std::addressof( callable ) ) );
+		}
+
+		Ret operator()( Args... args ) const { return mInvoke( mTarget, std::forward<Args>( args )... ); }
+
+	private:
+		union Target {
+			void *	callable;
+			Ret		( *function )( Args... );
+		};
+
+		Target	mTarget;
+		Ret		( *mInvoke )( Target, Args... );
+	};
+
 	typedef std::shared_ptr<class RenderModel> RenderModelRef;
+	typedef std::shared_ptr<struct RenderModelData> RenderModelDataRef;
+
+	//! Render model vertex quantized at load time to half the size of vr::RenderModel_Vertex_t: a half-float
+	//! position (w is 1), an octahedral-encoded normal as two snorm shorts and unorm short texture coordinates.
+	struct PackedRenderModelVertex
+	{
+		uint16_t	position[4];
+		int16_t		normal[2];
+		uint16_t	texCoord[2];
+	};
+
+	//! Render model geometry, reordered for the post-transform cache and overdraw, and pre-mipmapped RGBA8 texture,
+	//! viewed in place inside a cache blob (a memory-mapped cache file, or an in-memory copy when the cache cannot be written).
+	struct RenderModelData
+	{
+		std::string							name;
+		const PackedRenderModelVertex *		vertices;
+		uint32_t							vertexCount;
+		const uint16_t *					indices;
+		uint32_t							indexCount;
+		const uint8_t *						textureLevels;		// mip levels packed back to back, largest first
+		uint16_t							textureWidth;
+		uint16_t							textureHeight;
+		uint32_t							textureLevelCount;
+		uint32_t							sourceSize;			// bytes of the runtime's vertices, indices and base texture
+		std::shared_ptr<void>				storage;			// keeps the mapping or buffer alive
+	};
+
+	//! Geometry of all render models in one vertex and one index buffer, and their textures in the layers of one
+	//! mipmapped array texture, so that every visible device is drawn by a single multi-draw-indirect call per eye,
+	//! or one instanced draw per model before GL 4.3. Textures larger than LAYER_SIZE drop their largest mips and
+	//! smaller ones fill a corner of their layer. The model data stays referenced so that the layers can be
+	//! re-uploaded when the array grows. With \a compressTextures the layers are stored as DXT1, compressed by the
+	//! driver on upload, when EXT_texture_compression_s3tc is available.
+	class RenderModelBatch : ci::Noncopyable {
+	public:
+		static const int LAYER_SIZE = 1024;
+
+		explicit RenderModelBatch( bool compressTextures = false );
+		~RenderModelBatch();
+
+		//! Appends the geometry of \a data to the shared buffers and returns the model's slot.
+		int addGeometry( const RenderModelDataRef & data );
+		//! Copies the texture of the model in \a slot into its layer, after which the model is ready to draw.
+		void addTexture( int slot );
+		bool isReady( int slot ) const { return slot >= 0 && slot < (int)mModels.size() && mModels[slot].textureDone; }
+
+		//! Forgets the instances of the previous frame.
+		void clear();
+		//! Queues an instance of the model in \a slot, placed by \a transform, for draw().
+		void addInstance( int slot, const glm::mat4 & transform );
+		size_t getNumInstances() const { return mInstances.size(); }
+		bool isCompressed() const { return mCompressed; }
+
+		//! Bytes of GPU memory the model in \a slot takes less than the runtime's data uploaded as is, negative if more.
+		int64_t getBytesSaved( int slot ) const;
+		int64_t getTotalBytesSaved() const;
+		//! Draws the queued instances with the current view and projection matrices; the first call after clear() uploads them.
+		void draw();
+		//! Draws the model in \a slot once with the current model, view and projection matrices.
+		void drawSingle( int slot );
+
+	private:
+		static const int NUM_LAYER_LEVELS = 11;
+
+		struct Model {
+			RenderModelDataRef	data;
+			GLuint				firstIndex;
+			GLint				baseVertex;
+			glm::vec2			uvScale;
+			bool				textureDone;
+			size_t				gpuSize;
+		};
+		struct Instance {
+			glm::mat4	transform;
+			glm::vec4	texture;		// uv scale, layer
+		};
+		// layout of GL's DrawElementsIndirectCommand
+		struct DrawCommand {
+			GLuint	count;
+			GLuint	instanceCount;
+			GLuint	firstIndex;
+			GLint	baseVertex;
+			GLuint	baseInstance;
+		};
+
+		void setupVao( const ci::gl::VaoRef & vao, const ci::gl::VboRef & instances );
+		void pointInstanceAttribs( size_t offset );
+		void allocateLayers( int numLayers );
+		void uploadLayer( int slot );
+		size_t getLayerBytes() const;
+		void uploadInstances();
+		Instance makeInstance( int slot, const glm::mat4 & transform ) const;
+
+		ci::gl::GlslProgRef		mGlsl;
+		ci::gl::VboRef			mVertices;
+		ci::gl::VboRef			mIndices;
+		ci::gl::VboRef			mInstanceVbo;
+		ci::gl::VboRef			mSingleInstanceVbo;
+		ci::gl::VboRef			mIndirectVbo;
+		ci::gl::VaoRef			mVao;
+		ci::gl::VaoRef			mSingleVao;
+		GLuint					mTexture;
+		int						mNumLayers;
+		bool					mMultiDrawIndirect;
+		bool					mCompressed;
+		std::vector<uint8_t>	mPaddedLevel;
+
+		std::vector<Model>		mModels;
+		uint32_t				mNumVertices;
+		uint32_t				mNumIndices;
+
+		std::vector<std::pair<int, glm::mat4>>	mInstances;
+		std::vector<Instance>	mInstanceData;
+		std::vector<DrawCommand> mCommands;
+		bool					mInstancesUploaded;
+	};
 
 	class RenderModel {
 	public:
@@ -14,18 +189,74 @@ namespace hmd {
 			const std::string & name,
 			const vr::RenderModel_t & vrModel,
 			const vr::RenderModel_TextureMap_t & texture,
-			ci::gl::GlslProgRef shader )
+			RenderModelBatch * batch );
+		//! Creates an empty model whose geometry and texture are uploaded later by the RenderModelLoader.
+		static RenderModelRef create( const std::string & name, RenderModelBatch * batch )
 		{
-			return RenderModelRef( new RenderModel{ name, vrModel, texture, shader } );
+			return RenderModelRef( new RenderModel{ name, batch } );
 		}
+		//! Draws the model on its own with the current matrices. HtcVive draws all devices at once through the batch.
 		void draw();
 		const std::string & GetName() const { return mModelName; }
+		//! Returns whether both geometry and texture have been uploaded.
+		bool isReady() const { return mBatch->isReady( mSlot ); }
+		//! Slot of the model in its RenderModelBatch, -1 until the geometry is uploaded.
+		int getSlot() const { return mSlot; }
 	private:
-		RenderModel( const std::string & name, const vr::RenderModel_t & vrModel, const vr::RenderModel_TextureMap_t & texture, ci::gl::GlslProgRef shader );
+		RenderModel( const std::string & name, RenderModelBatch * batch );
+
+		void uploadGeometry( const RenderModelDataRef & data );
+		void uploadTexture();
 
-		ci::gl::BatchRef		mBatch;
-		ci::gl::Texture2dRef	mTexture;
+		RenderModelBatch *		mBatch;
+		int						mSlot;
 		std::string				mModelName;
+
+		friend class RenderModelLoader;
+	};
+
+	//! Loads render models on a worker thread and uploads them to GL incrementally on the render thread.
+	//! Models are cached by name; a model returned by request() stays a placeholder until isReady().
+	//! When \a cacheDirectory is not empty, processed models are persisted there and memory-mapped on later
+	//! runs. Cache files are keyed by model name and invalidated when \a runtimeKey changes.
+	class RenderModelLoader : ci::Noncopyable {
+	public:
+		RenderModelLoader( vr::IVRRenderModels * renderModels, RenderModelBatch * batch, const ci::fs::path & cacheDirectory, const std::string & runtimeKey );
+		~RenderModelLoader();
+
+		//! Returns the cached model for \a name, queuing a background load the first time it is requested.
+		RenderModelRef request( const std::string & name );
+		//! Uploads loaded models to GL until \a budgetMs is spent. Must be called on the GL thread.
+		void update( double budgetMs );
+
+		//! Returns the number of requested models that are not yet ready to draw.
+		size_t getNumPending() const;
+	private:
+		void loadThreadFn();
+		RenderModelDataRef load( const std::string & name );
+		ci::fs::path getCachePath( const std::string & name ) const;
+
+		vr::IVRRenderModels *	mRenderModels;
+		RenderModelBatch *		mBatch;
+		ci::fs::path			mCacheDirectory;
+		uint64_t				mRuntimeHash;
+
+		std::unordered_map<std::string, RenderModelRef> mCache;
+
+		// one upload step per entry: geometry first, then texture
+		struct Upload {
+			RenderModelRef		model;
+			RenderModelDataRef	data;
+			bool				geometryDone;
+		};
+		std::deque<Upload>		mUploads;
+
+		std::mutex				mMutex;
+		std::condition_variable	mCondition;
+		std::deque<std::string>	mLoadQueue;
+		std::deque<std::pair<std::string, RenderModelDataRef>> mLoaded;
+		bool					mQuit;
+		std::thread				mThread;
 	};
 
 	struct VertexDataLens
@@ -36,13 +267,684 @@ namespace hmd {
 		glm::vec2 texCoordBlue;
 	};
 
-	struct FramebufferDesc
+	//! Per-frame GL state changes of the library, made through Cinder's context so that its cached state stays correct.
+	//! Changes that would leave the cached state as it is are skipped, and issued and skipped calls are counted per frame.
+	//! Cinder does not know about sampler objects, so their bindings are shadowed here; nothing else should bind samplers.
+	class GlStateCache : ci::Noncopyable {
+	public:
+		GlStateCache();
+
+		void bindFramebuffer( GLenum target, GLuint framebuffer );
+		void bindGlslProg( const ci::gl::GlslProgRef & glsl );
+		void bindVao( const ci::gl::VaoRef & vao );
+		void bindTexture( GLenum target, GLuint texture, uint8_t unit = 0 );
+		void bindSampler( GLuint unit, GLuint sampler );
+		void enable( GLenum cap, bool enable = true );
+		void viewport( const glm::ivec2 & position, const glm::ivec2 & size );
+		void scissor( const glm::ivec2 & position, const glm::ivec2 & size );
+		//! Cinder does not track the color mask and stencil state, and the app may change them at any time, so these are
+		//! always issued and only counted.
+		void colorMask( bool red, bool green, bool blue, bool alpha );
+		void stencilFunc( GLenum func, GLint ref, GLuint mask );
+		void stencilOp( GLenum stencilFail, GLenum depthFail, GLenum depthPass );
+		void clear( GLbitfield mask );
+		//! Clears the stencil buffer (within the scissor rectangle, if enabled) to \a value, leaving the clear value at 0.
+		void clearStencil( GLint value );
+
+		//! Counts calls made around the cache, e.g. draws and blits, towards getCachedCallsIssued().
+		void countCalls( uint32_t count = 1 ) { mIssued += count; }
+
+		//! Starts counting the calls of a new frame.
+		void beginFrame();
+		//! GL calls the library issued through the cache or reported with countCalls() during the last complete frame.
+		//! Work done through Cinder's own wrappers (scoped bindings, gl::draw(), batches) and the app's calls are not included.
+		uint32_t getCachedCallsIssued() const { return mLastIssued; }
+		//! Redundant state changes skipped during the last complete frame.
+		uint32_t getCachedCallsSkipped() const { return mLastSkipped; }
+
+		//! GL 4.5 or ARB_direct_state_access, for blits and invalidations that need no framebuffer binding at all.
+		bool hasDirectStateAccess() const { return mDirectStateAccess; }
+
+	private:
+		static const GLuint NUM_SAMPLER_UNITS = 4;
+
+		bool		mDirectStateAccess;
+		GLuint		mSamplers[NUM_SAMPLER_UNITS];
+		uint32_t	mIssued;
+		uint32_t	mSkipped;
+		uint32_t	mLastIssued;
+		uint32_t	mLastSkipped;
+	};
+
+	//! Eye render target: a color and depth framebuffer, multisampled unless created with one sample, resolved into
+	//! one of numBuffers single-sampled textures. select() rotates the texture so that one still read by the compositor
+	//! is never overwritten. Without MSAA the scene renders straight into the selected texture and no blit is needed.
+	class RenderTarget : ci::Noncopyable {
+	public:
+		//! Throws ViveExeption if the framebuffers are incomplete, e.g. for a format or sample count the GPU does not support.
+		RenderTarget( const glm::ivec2 & size, int samples, GLenum colorFormat, GLenum depthFormat, int numBuffers );
+		~RenderTarget();
+
+		//! Selects the resolve texture that the next frame is resolved into.
+		void select( int buffer ) { mBuffer = buffer; }
+		int getNumBuffers() const { return (int)mResolveTextures.size(); }
+
+		bool isMultisampled() const { return mSamples > 1; }
+		bool hasStencil() const { return mHasStencil; }
+		//! How the compositor interprets the color format: linear for floating point, decoded on sampling for sRGB and gamma otherwise.
+		vr::EColorSpace getColorSpace() const { return mColorSpace; }
+		const glm::ivec2 & getSize() const { return mSize; }
+
+		GLuint getRenderFramebuffer() const { return isMultisampled() ? mRenderFramebuffer : mResolveFramebuffers[mBuffer]; }
+		GLuint getResolveTexture() const { return mResolveTextures[mBuffer]; }
+
+		//! Resolves the bottom left \a size pixels into the selected texture, then invalidates the depth and multisampled
+		//! color contents so that tiled and compressing GPUs can skip writing them back.
+		void resolve( const glm::ivec2 & size, GlStateCache & state );
+
+	private:
+		void destroy();
+
+		glm::ivec2				mSize;
+		int						mSamples;
+		bool					mHasStencil;
+		vr::EColorSpace			mColorSpace;
+		bool					mCanInvalidate;
+		GLuint					mRenderFramebuffer;
+		GLuint					mColorBuffer;
+		GLuint					mDepthBuffer;
+		std::vector<GLuint>		mResolveFramebuffers;
+		std::vector<GLuint>		mResolveTextures;
+		int						mBuffer;
+	};
+
+	//! Matrices of the eye being rendered, exposed to multi-pass shaders through the std140 "ViveEye" uniform block.
+	struct EyeUniforms
+	{
+		glm::mat4 viewMatrix;
+		glm::mat4 projectionMatrix;
+		glm::mat4 viewProjectionMatrix;
+		glm::mat4 devicePose[vr::k_unMaxTrackedDeviceCount];
+	};
+
+	//! Matrices of both eyes, exposed to single-pass stereo shaders through the std140 "ViveStereo" uniform block.
+	struct StereoUniforms
 	{
-		GLuint m_nDepthBufferId;
-		GLuint m_nRenderTextureId;
-		GLuint m_nRenderFramebufferId;
-		GLuint m_nResolveTextureId;
-		GLuint m_nResolveFramebufferId;
+		glm::mat4 viewMatrix[2];
+		glm::mat4 projectionMatrix[2];
+		glm::mat4 viewProjectionMatrix[2];
+		glm::mat4 devicePose[vr::k_unMaxTrackedDeviceCount];
+	};
+
+	//! Triple-buffered uniform buffer holding a frame's EyeUniforms and StereoUniforms. When persistent mapping is
+	//! supported (GL 4.4 or ARB_buffer_storage), each frame's slice is written in place without a buffer upload; fences
+	//! keep the CPU from overwriting slices the GPU is still reading.
+	class PoseUniformBuffer : ci::Noncopyable {
+	public:
+		PoseUniformBuffer();
+		~PoseUniformBuffer();
+
+		//! Returns whether the buffer is persistently mapped.
+		bool isPersistent() const { return mMapped != nullptr; }
+
+		//! Moves on to the next slice, waiting for the GPU to release it first.
+		void beginFrame();
+		//! Writes the current slice. Called once per frame, after the poses were updated.
+		void write( const EyeUniforms & left, const EyeUniforms & right, const StereoUniforms & stereo );
+		void bindEye( vr::Hmd_Eye eye, GLuint binding ) const;
+		void bindStereo( GLuint binding ) const;
+		//! Fences the current slice once all of the frame's GPU work has been issued.
+		void endFrame();
+
+	private:
+		static const int NUM_SLICES = 3;
+
+		GLuint		mBuffer;
+		uint8_t *	mMapped;
+		GLintptr	mEyeOffset[2];
+		GLintptr	mStereoOffset;
+		GLsizeiptr	mSliceSize;
+		int			mSlice;
+		GLsync		mFences[NUM_SLICES];
+	};
+
+	//! Pose and velocities of a tracked device at \a time, in seconds on HtcVive::getTrackingTime()'s clock.
+	//! Everything is in tracking space, as reported by vr::TrackedDevicePose_t (m, m/s, rad/s).
+	struct DeviceMotion
+	{
+		glm::vec3	position;
+		glm::quat	orientation;
+		glm::vec3	velocity;
+		glm::vec3	angularVelocity;
+		double		time;
+		bool		valid;
+
+		//! Extrapolates to \a targetTime at constant linear and angular velocity and returns the device-to-tracking transform.
+		glm::mat4 predict( double targetTime ) const;
+	};
+
+	//! Motion of every tracked device slot from one WaitGetPoses, stored as structure of arrays so that predict()
+	//! runs the same branch-free arithmetic over all slots, four at a time with SSE where available.
+	struct DeviceMotionBatch
+	{
+		static const int SIZE = vr::k_unMaxTrackedDeviceCount;
+
+		DeviceMotionBatch();
+
+		void set( uint32_t device, const DeviceMotion & motion );
+		DeviceMotion get( uint32_t device ) const;
+
+		//! Predicts all slots at \a targetTime into \a poses (SIZE matrices); invalid slots are written as identity.
+		//! Rotations use a series expansion that stays within 1e-3 of DeviceMotion::predict() for rotations below ~3 rad.
+		void predict( double targetTime, glm::mat4 * poses ) const;
+
+		float	px[SIZE], py[SIZE], pz[SIZE];
+		float	qx[SIZE], qy[SIZE], qz[SIZE], qw[SIZE];
+		float	vx[SIZE], vy[SIZE], vz[SIZE];
+		float	wx[SIZE], wy[SIZE], wz[SIZE];
+		bool	valid[SIZE];
+		double	time;
+	};
+
+	//! Fixed-size ring of trivially copyable records with a single writer and any number of wait-free readers.
+	//! Each slot carries a sequence counter so that readers can detect and discard records rewritten while being copied.
+	template<typename T, size_t N>
+	class SeqlockRing : ci::Noncopyable {
+	public:
+		SeqlockRing() : mWriteCount( 0 )
+		{
+			for( auto & slot : mSlots )
+				slot.sequence.store( 0, std::memory_order_relaxed );
+		}
+
+		//! Appends \a value, overwriting the oldest record once the ring is full. Writer thread only.
+		void push( const T & value )
+		{
+			uint64_t index = mWriteCount.load( std::memory_order_relaxed );
+			Slot & slot = mSlots[index % N];
+			uint64_t sequence = slot.sequence.load( std::memory_order_relaxed );
+			slot.sequence.store( sequence + 1, std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_release );
+			slot.value = value;
+			slot.sequence.store( sequence + 2, std::memory_order_release );
+			mWriteCount.store( index + 1, std::memory_order_release );
+		}
+
+		//! Returns the total number of records pushed so far.
+		uint64_t getWriteCount() const { return mWriteCount.load( std::memory_order_acquire ); }
+
+		//! Copies the record of the \a index-th push into \a result. Returns false if it was not written yet, was overwritten or is being written.
+		bool read( uint64_t index, T * result ) const
+		{
+			uint64_t writeCount = getWriteCount();
+			if( index >= writeCount || index + N < writeCount )
+				return false;
+
+			const Slot & slot = mSlots[index % N];
+			uint64_t sequence = slot.sequence.load( std::memory_order_acquire );
+			*result = slot.value;
+			std::atomic_thread_fence( std::memory_order_acquire );
+			// the index-th push is the (index / N + 1)-th write to this slot, leaving its sequence at twice that count
+			return sequence == 2 * ( index / N + 1 ) && slot.sequence.load( std::memory_order_relaxed ) == sequence;
+		}
+
+		static size_t capacity() { return N; }
+
+	private:
+		struct Slot {
+			std::atomic<uint64_t>	sequence;
+			T						value;
+		};
+		std::array<Slot, N>			mSlots;
+		std::atomic<uint64_t>		mWriteCount;
+	};
+
+	//! History of the last CAPACITY DeviceMotionBatch snapshots, published by the render thread once per frame.
+	//! Any number of other threads (physics, audio, haptics) can sample it wait-free at their own target times.
+	class PoseHistory : ci::Noncopyable {
+	public:
+		static const size_t CAPACITY = 64;
+
+		//! Appends a snapshot. Render thread only.
+		void publish( const DeviceMotionBatch & motion ) { mSnapshots.push( motion ); }
+
+		//! Copies the newest snapshot into \a result. Returns false if nothing was published yet.
+		bool getLatest( DeviceMotionBatch * result ) const;
+		//! Computes the device-to-tracking transform of \a device at \a time (see HtcVive::getTrackingTime()), interpolating
+		//! between the snapshots around \a time and extrapolating from the nearest one outside the recorded range.
+		//! Returns false if no snapshot with a valid pose of \a device is available.
+		bool sample( vr::TrackedDeviceIndex_t device, double time, glm::mat4 * pose ) const;
+
+	private:
+		SeqlockRing<DeviceMotionBatch, CAPACITY>	mSnapshots;
+	};
+
+	//! Runs WaitGetPoses and Submit on its own thread, with a GL context shared with the render thread's. The render
+	//! thread renders with predicted poses instead of waiting for WaitGetPoses, hands each frame's resolved textures over
+	//! with a fence and moves on without waiting for the GPU or the compositor; numSlots resolve textures per target
+	//! rotate so that a frame is never overwritten while being submitted. The render thread only blocks once it is a
+	//! whole frame ahead of the compositor, which paces it to the display.
+	//! The compositor is passed in rather than taken from vr::VRCompositor(), so the thread can be driven by a stand-in.
+	class CompositorThread : ci::Noncopyable {
+	public:
+		struct Frame {
+			int		slot;
+			GLuint	leftTexture;
+			GLuint	rightTexture;		// same as leftTexture for double-wide frames
+			vr::VRTextureBounds_t	bounds[2];
+			vr::EColorSpace			colorSpace;
+			GLsync	fence;				// signaled once the frame is resolved, deleted by the compositor thread
+		};
+
+		CompositorThread( vr::IVRCompositor * compositor, const ci::gl::ContextRef & sharedContext, int numSlots );
+		~CompositorThread();
+
+		//! Returns the slot to resolve the next frame into, blocking while it is still being submitted.
+		int acquireSlot();
+		//! Queues \a frame for submission once its fence is signaled, blocking while the previous frame still waits for
+		//! the compositor thread to pick it up.
+		void submit( const Frame & frame );
+
+	private:
+		void threadFn();
+
+		vr::IVRCompositor *		mCompositor;
+		ci::gl::ContextRef		mContext;
+
+		std::mutex				mMutex;
+		std::condition_variable	mCondition;
+		Frame					mFrame;
+		bool					mFramePending;
+		std::vector<bool>		mSlotBusy;
+		int						mNextSlot;
+		bool					mQuit;
+		std::thread				mThread;
+	};
+
+	//! Scales the rendered eye resolution to keep the GPU frame time under a budget. The time between beginFrame() and
+	//! endFrame() comes from timestamp queries read back NUM_QUERY_SETS frames late. The scale drops as soon as the
+	//! smoothed time exceeds the budget, but only grows again after GROW_DELAY_FRAMES frames well under it, so that
+	//! it settles instead of oscillating around the budget.
+	class ResolutionScaler : ci::Noncopyable {
+	public:
+		ResolutionScaler();
+		~ResolutionScaler();
+
+		//! Creates or releases the GL queries, so it must be called on the GL thread. Disabling restores the maximum scale.
+		void setEnabled( bool enable );
+		bool isEnabled() const { return mEnabled; }
+
+		//! GPU time per frame to stay under, in milliseconds.
+		void setBudgetMs( double ms ) { mBudgetMs = ms; }
+		double getBudgetMs() const { return mBudgetMs; }
+		//! Range of the scale applied to each axis of the render size. Defaults to 0.5 to 1.
+		void setScaleRange( float minScale, float maxScale );
+		float getMinScale() const { return mMinScale; }
+		float getMaxScale() const { return mMaxScale; }
+
+		float getScale() const { return mScale; }
+		//! Smoothed GPU frame time at the current scale, negative until measured.
+		double getGpuMs() const { return mGpuMs; }
+
+		void beginFrame();
+		void endFrame();
+
+	private:
+		static const int NUM_QUERY_SETS = 3;
+		static const int GROW_DELAY_FRAMES = 45;
+
+		void adapt( double gpuMs );
+
+		bool	mEnabled;
+		double	mBudgetMs;
+		float	mMinScale;
+		float	mMaxScale;
+		float	mScale;
+		double	mGpuMs;
+		int		mFramesUnderBudget;
+		int		mSettleFrames;		// measurements still in flight from before the last scale change
+		int		mQuerySet;
+		bool	mPending[NUM_QUERY_SETS];
+		GLuint	mQueries[NUM_QUERY_SETS][2];
+	};
+
+	//! Collects per-stage CPU and GPU times of the frame loop. Timings are recorded on the render thread and published
+	//! into a lock-free ring that can be queried from any thread. GPU times come from double-buffered GL timestamp
+	//! queries and are published two frames late so that reading them never stalls.
+	class FrameProfiler : ci::Noncopyable {
+	public:
+		//! Single-pass stereo records both eyes under STAGE_SCENE_LEFT.
+		enum Stage { STAGE_UPDATE, STAGE_POSES, STAGE_SCENE_LEFT, STAGE_SCENE_RIGHT, STAGE_RESOLVE, STAGE_DISTORTION, STAGE_SUBMIT, NUM_STAGES };
+
+		struct FrameTiming {
+			uint64_t	frameIndex;
+			double		cpuFrameMs;				// update() to the end of unbind()
+			double		cpuMs[NUM_STAGES];		// 0 when the stage did not run
+			double		gpuMs[NUM_STAGES];		// negative when no GPU time is available
+		};
+
+		struct Stats {
+			double	min;
+			double	avg;
+			double	p99;
+			size_t	count;
+		};
+
+		FrameProfiler();
+		~FrameProfiler();
+
+		//! Enables or disables recording. Creates or releases the GL queries, so it must be called on the GL thread.
+		void setEnabled( bool enable );
+		bool isEnabled() const { return mEnabled; }
+
+		void beginFrame();
+		void endFrame();
+		void beginStage( Stage stage );
+		void endStage( Stage stage );
+
+		//! Copies up to \a maxFrames of the most recent timings into \a result, oldest first. Safe to call from any thread.
+		void getTimings( std::vector<FrameTiming> * result, size_t maxFrames = TIMING_CAPACITY ) const;
+		//! Returns min/avg/p99 of a stage over the last \a maxFrames frames. Safe to call from any thread.
+		Stats getStats( Stage stage, bool gpu, size_t maxFrames = TIMING_CAPACITY ) const;
+		//! Writes the last \a maxFrames timings as CSV. Safe to call from any thread.
+		bool writeCsv( const ci::fs::path & path, size_t maxFrames = TIMING_CAPACITY ) const;
+
+		static const char * getStageName( Stage stage );
+
+		static const size_t TIMING_CAPACITY = 1024;
+
+		//! Records \a stage for the lifetime of the object.
+		struct ScopedStage : ci::Noncopyable {
+			ScopedStage( FrameProfiler & profiler, Stage stage ) : mProfiler( profiler ), mStage( stage ) { mProfiler.beginStage( mStage ); }
+			~ScopedStage() { mProfiler.endStage( mStage ); }
+		private:
+			FrameProfiler &	mProfiler;
+			Stage			mStage;
+		};
+
+	private:
+		static const int NUM_QUERY_SETS = 2;
+		static const int MAX_STAGE_SPANS = 2;	// e.g. the resolve runs once per eye
+
+		struct QuerySet {
+			FrameTiming	timing;
+			bool		pending;
+			double		frameStart;
+			double		stageStart[NUM_STAGES];
+			int			numSpans[NUM_STAGES];
+			GLuint		queries[NUM_STAGES][MAX_STAGE_SPANS][2];
+		};
+
+		void publish( QuerySet & set );
+
+		bool			mEnabled;
+		bool			mInFrame;
+		uint64_t		mFrameIndex;
+		ci::Timer		mClock;
+		QuerySet		mQuerySets[NUM_QUERY_SETS];
+		QuerySet *		mCurrent;
+
+		SeqlockRing<FrameTiming, TIMING_CAPACITY> mTimings;
+	};
+
+#if CINDER_VIVE_LATENCY_TRACKING
+	//! Measures how old the poses rendered with are: from WaitGetPoses returning, to each eye's view matrix
+	//! being consumed, to the frame being submitted. Pose ages at submit accumulate in a histogram and the
+	//! most recent samples are kept in a lock-free ring; both can be read from any thread.
+	class LatencyTracker : ci::Noncopyable {
+	public:
+		struct Sample {
+			uint64_t	frameIndex;
+			double		posesTime;				// seconds, on the tracker's clock
+			double		eyeTime[2];				// when each eye's view matrix was consumed
+			double		submitTime;
+			double		eyeAgeMs[2];			// pose age when each eye started rendering
+			double		submitAgeMs;			// pose age when the frame was submitted
+		};
+
+		static const int	NUM_BINS = 200;		// the last bin collects everything beyond the range
+		static const int	SAMPLE_CAPACITY = 512;
+		static double		getBinWidthMs() { return 0.25; }
+
+		LatencyTracker();
+
+		void markPosesReady();
+		void markEyeConsumed( vr::Hmd_Eye eye );
+		void markSubmitted();
+
+		//! Clears the histogram.
+		void reset();
+		//! Returns the number of frames per bin of submit pose age.
+		std::vector<uint32_t> getHistogram() const;
+		//! Returns the submit pose age below which \a percentile (0-1) of the frames fall, at bin resolution.
+		double getPercentileMs( double percentile ) const;
+		//! Copies up to \a maxSamples of the most recent samples into \a result, oldest first.
+		void getSamples( std::vector<Sample> * result, size_t maxSamples = SAMPLE_CAPACITY ) const;
+		//! Writes the histogram as CSV (bin start in ms, count).
+		bool writeCsv( const ci::fs::path & path ) const;
+
+	private:
+		ci::Timer							mClock;
+		Sample								mCurrent;
+		bool								mHasPoses;
+		uint64_t							mFrameIndex;
+		std::array<std::atomic<uint32_t>, NUM_BINS>	mHistogram;
+		SeqlockRing<Sample, SAMPLE_CAPACITY>		mSamples;
+	};
+#endif
+
+	//! Frustum culling shared by both eye passes. update() extracts the planes of each eye's view-projection matrix and
+	//! keeps the ones that bound both eyes as the combined frustum, which is what the batch tests use, so an object is
+	//! tested once per frame instead of once per eye. The tests check one object against four planes per SSE instruction.
+	//! When no plane of either eye bounds both frusta in some direction (strongly canted displays), that direction is
+	//! simply not culled.
+	class StereoCuller : ci::Noncopyable {
+	public:
+		StereoCuller();
+
+		//! Starts a new frame, which forgets the results cached by cullSpheres() and cullBoxes().
+		void update( const glm::mat4 & leftViewProjection, const glm::mat4 & rightViewProjection );
+
+		//! Distance in meters the combined frustum is pushed outwards, e.g. to hide popping at the frustum edges. Defaults to 0.
+		void setMargin( float meters ) { mMargin = meters; }
+		float getMargin() const { return mMargin; }
+
+		//! Planes (xyz normal pointing inwards, w distance) of the combined frustum.
+		const std::vector<glm::vec4> & getPlanes() const { return mPlanes; }
+		//! Left, right, bottom, top, near and far planes of \a eye's frustum.
+		const std::array<glm::vec4, 6> & getEyePlanes( vr::Hmd_Eye eye ) const { return mEyePlanes[eye]; }
+
+		bool isVisible( const ci::Sphere & sphere ) const;
+		bool isVisible( const ci::AxisAlignedBox & box ) const;
+
+		//! Tests \a count spheres and returns one flag per sphere, 1 when it may be visible to either eye. The result is kept
+		//! until the next update(), so calling again with the same array, as the second eye pass does, returns it untested.
+		//! The array must not change in between.
+		const uint8_t * cullSpheres( const ci::Sphere * spheres, size_t count );
+		//! Tests \a count boxes like cullSpheres().
+		const uint8_t * cullBoxes( const ci::AxisAlignedBox * boxes, size_t count );
+
+		//! Uncached tests writing a flag per object into \a visible. Return the number of visible objects.
+		size_t testSpheres( const ci::Sphere * spheres, size_t count, uint8_t * visible ) const;
+		size_t testBoxes( const ci::AxisAlignedBox * boxes, size_t count, uint8_t * visible ) const;
+
+		//! Objects tested and found visible since the last update(); cached results are not counted again.
+		size_t getNumTested() const { return mNumTested; }
+		size_t getNumVisible() const { return mNumVisible; }
+
+	private:
+		// four planes in structure-of-arrays layout, with the absolute normals for the box tests
+		struct alignas( 16 ) PlaneGroup {
+			float	nx[4], ny[4], nz[4], d[4];
+			float	ax[4], ay[4], az[4];
+		};
+		struct Result {
+			const void *			objects;
+			size_t					count;
+			bool					valid;
+			std::vector<uint8_t>	visible;
+		};
+
+		Result & findResult( const void * objects, size_t count );
+
+		float								mMargin;
+		std::array<glm::vec4, 6>			mEyePlanes[2];
+		std::vector<glm::vec4>				mPlanes;
+		std::vector<PlaneGroup>				mPlaneGroups;
+		std::vector<Result>					mResults;
+		size_t								mNumTested;
+		size_t								mNumVisible;
+	};
+
+	//! GPU-driven culling for a large instanced batch: a compute shader tests each instance's bounding sphere against
+	//! StereoCuller's combined frustum once per frame and appends the survivors to getVisibleInstances(), counting them
+	//! straight into an indirect draw command, so both eyes draw the same compacted list without a CPU readback.
+	//! Needs GL 4.3 (compute shaders, storage buffers, multi-draw-indirect), which Mesa's llvmpipe provides; on older
+	//! contexts every instance is copied and drawn.
+	class GpuInstanceCuller : ci::Noncopyable {
+	public:
+		GpuInstanceCuller();
+
+		//! Uploads one bounding sphere per instance, center in xyz and radius in w.
+		void setInstances( const std::vector<glm::vec4> & spheres );
+		GLuint getNumInstances() const { return mNumInstances; }
+
+		//! The spheres of the visible instances, compacted. Append it to the batch's VboMesh as per-instance data
+		//! (stride sizeof( vec4 )) before creating the batch that draw() is given.
+		const ci::gl::VboRef & getVisibleInstances() const { return mVisible; }
+
+		//! Culls the instances against \a culler's combined frustum. Call once per frame after HtcVive::bind(). Each
+		//! visible instance adds \a instancesPerVisible instances to the draw, e.g. 2 for single-pass stereo.
+		void cull( const StereoCuller & culler, GLuint instancesPerVisible = 1 );
+		//! Draws \a batch with the instance count left by cull(), in each eye pass.
+		void draw( const ci::gl::BatchRef & batch );
+
+		//! Reads back the number of visible instances of the last cull(), which waits for the GPU. Meant for benchmarks.
+		GLuint readNumVisible() const;
+		bool isSupported() const { return mSupported; }
+
+	private:
+		static const int MAX_PLANES = 12;
+		static const GLuint LOCAL_SIZE = 64;
+
+		// layout of GL's DrawElementsIndirectCommand
+		struct DrawCommand {
+			GLuint	count;
+			GLuint	instanceCount;
+			GLuint	firstIndex;
+			GLint	baseVertex;
+			GLuint	baseInstance;
+		};
+
+		bool					mSupported;
+		ci::gl::GlslProgRef		mGlslCull;
+		ci::gl::VboRef			mInstances;
+		ci::gl::VboRef			mVisible;
+		ci::gl::VboRef			mCommand;
+		GLuint					mNumInstances;
+		GLuint					mInstancesPerVisible;
+		GLuint					mIndexCount;
+		GLint					mPlanesLocation;
+		GLint					mNumPlanesLocation;
+		GLint					mNumInstancesLocation;
+		GLint					mInstancesPerVisibleLocation;
+	};
+
+	//! Per-instance data rewritten every frame (transforms, colors), streamed through a persistently mapped buffer of
+	//! NUM_SLICES frame slices. Each slice is fenced once the frame's draws are issued and only written again after
+	//! the GPU released it, so writes never reallocate or implicitly synchronize. Both eye passes draw the same slice,
+	//! which is selected through the base instance. Without GL 4.4 buffer storage the slices are written with
+	//! glBufferSubData, and without GL 4.2 base instances a single slice is orphaned every frame.
+	class InstanceStream : ci::Noncopyable {
+	public:
+		static const int NUM_SLICES = 3;
+
+		//! Room for \a maxInstances instances of \a instanceSize bytes per frame.
+		InstanceStream( size_t instanceSize, uint32_t maxInstances );
+		~InstanceStream();
+
+		bool isPersistent() const { return mMapped != nullptr; }
+		size_t getInstanceSize() const { return mInstanceSize; }
+		uint32_t getMaxInstances() const { return mMaxInstances; }
+
+		//! The streamed buffer. Append it to a batch's VboMesh as per-instance data, with a stride of getInstanceSize()
+		//! and offsets within one instance.
+		const ci::gl::VboRef & getVbo() const { return mVbo; }
+
+		//! Moves on to the next slice, waiting for the GPU to release it first, and returns where to write up to getMaxInstances() instances.
+		void * beginFrame();
+		template<typename T>
+		T * beginFrame() { return static_cast<T *>( beginFrame() ); }
+		//! Publishes the first \a count instances written since beginFrame().
+		void commit( uint32_t count );
+		uint32_t getCount() const { return mCount; }
+
+		//! Draws \a batch with the instances of this frame's slice, \a instancesPerStreamed times each (2 for single-pass stereo).
+		void draw( const ci::gl::BatchRef & batch, GLuint instancesPerStreamed = 1 );
+		//! Fences the current slice once all of the frame's draws from it have been issued.
+		void endFrame();
+
+	private:
+		ci::gl::VboRef			mVbo;
+		uint8_t *				mMapped;
+		std::vector<uint8_t>	mStaging;
+		size_t					mInstanceSize;
+		uint32_t				mMaxInstances;
+		int						mNumSlices;
+		int						mSlice;
+		uint32_t				mCount;
+		GLsync					mFences[NUM_SLICES];
+	};
+
+	typedef std::shared_ptr<class Layer> LayerRef;
+
+	//! Content that changes far less often than the scene, such as HUDs, menus or distant backdrops, rendered into a
+	//! texture of its own and drawn from there into both eyes as a quad. See HtcVive::addLayer().
+	class Layer : ci::Noncopyable {
+	public:
+		enum Space {
+			SPACE_WORLD,	//!< the transform places the quad in the world, like the scene
+			SPACE_HEAD		//!< the transform places the quad relative to the headset, which it follows
+		};
+
+		//! Renders the layer again at the next bind().
+		void markDirty() { mDirty = true; }
+		bool isDirty() const { return mDirty; }
+		//! Renders the layer again every \a frames frames; 0 only when marked dirty.
+		void setUpdateInterval( int frames ) { mUpdateInterval = std::max( frames, 0 ); }
+		int getUpdateInterval() const { return mUpdateInterval; }
+
+		//! Places the quad, which spans -0.5 to 0.5 in x and y with the top of the texture towards +y, by \a transform in \a space.
+		void setTransform( const glm::mat4 & transform, Space space = SPACE_WORLD ) { mTransform = transform; mSpace = space; }
+		const glm::mat4 & getTransform() const { return mTransform; }
+		Space getSpace() const { return mSpace; }
+		//! Hidden layers are neither drawn nor rendered; a layer marked dirty meanwhile renders once shown again.
+		void setVisible( bool visible = true ) { mVisible = visible; }
+		bool isVisible() const { return mVisible; }
+		//! Without the depth test the quad is drawn over the scene, as a HUD would be. Defaults to true.
+		void setDepthTested( bool depthTested = true ) { mDepthTested = depthTested; }
+		bool isDepthTested() const { return mDepthTested; }
+
+		//! The cached content with premultiplied alpha. Each render starts from transparent black, with blending that keeps
+		//! alpha-blended draws premultiplied.
+		const ci::gl::FboRef & getFbo() const { return mFbo; }
+		//! Times the render callback ran.
+		uint64_t getRenderCount() const { return mRenderCount; }
+
+	private:
+		Layer( const glm::ivec2 & size, const std::function<void()> & render, int updateInterval );
+
+		ci::gl::FboRef			mFbo;
+		std::function<void()>	mRender;
+		int						mUpdateInterval;
+		bool					mDirty;
+		glm::mat4				mTransform;
+		Space					mSpace;
+		bool					mVisible;
+		bool					mDepthTested;
+		uint64_t				mRenderCount;
+
+		friend class HtcVive;
 	};
 
 	typedef std::shared_ptr<class HtcVive> HtcViveRef;
@@ -50,18 +952,195 @@ namespace hmd {
 	class HtcVive : ci::Noncopyable
 	{
 	public:
-		static HtcViveRef create() { return HtcViveRef{ new HtcVive }; }
+		struct Options {
+			Options();
+
+			//! Directory for the persistent render model and lens distortion caches. An empty path disables caching. Defaults to a CinderVive folder in the temporary directory.
+			Options& cacheDirectory( const ci::fs::path & directory ) { mCacheDirectory = directory; return *this; }
+			const ci::fs::path & getCacheDirectory() const { return mCacheDirectory; }
+
+			//! Number of vertices along each axis of the per-eye lens distortion grid. Defaults to 43 x 43.
+			Options& lensGridSize( const glm::ivec2 & size ) { mLensGridSize = size; return *this; }
+			const glm::ivec2 & getLensGridSize() const { return mLensGridSize; }
+
+			//! Moves WaitGetPoses and Submit to a CompositorThread so that the render thread never blocks on the compositor.
+			//! bind() then predicts poses one frame further ahead, since each frame reaches the compositor a frame later. Defaults to false.
+			Options& pipelinedSubmit( bool enable = true ) { mPipelinedSubmit = enable; return *this; }
+			bool isPipelinedSubmit() const { return mPipelinedSubmit; }
+
+			//! MSAA sample count of the eye targets. One or less renders straight into the submitted textures without a resolve blit. Defaults to 4.
+			Options& msaaSamples( int samples ) { mMsaaSamples = samples; return *this; }
+			int getMsaaSamples() const { return mMsaaSamples; }
+
+			//! Sized internal format of the eye targets' color, e.g. GL_SRGB8_ALPHA8 or GL_RGBA16F. Floating point formats are
+			//! submitted as linear and sRGB ones as automatic, so that the compositor decodes them; others as gamma. Defaults to GL_RGBA8.
+			Options& colorFormat( GLenum format ) { mColorFormat = format; return *this; }
+			GLenum getColorFormat() const { return mColorFormat; }
+
+			//! Sized internal format of the eye targets' depth. The hidden area mask needs a stencil format. Defaults to GL_DEPTH24_STENCIL8.
+			Options& depthFormat( GLenum format ) { mDepthFormat = format; return *this; }
+			GLenum getDepthFormat() const { return mDepthFormat; }
+
+			//! Number of textures each eye is resolved into in turn, e.g. 3 for triple buffering. Pipelined submit uses at least 2. Defaults to 1.
+			Options& resolveBuffers( int count ) { mResolveBuffers = count; return *this; }
+			int getResolveBuffers() const { return mResolveBuffers; }
+
+			//! Renders the eyes of renderStereoTargets() side by side into one double-wide target, which is resolved once and submitted with per-eye bounds. Defaults to false.
+			Options& sharedEyeTarget( bool enable = true ) { mSharedEyeTarget = enable; return *this; }
+			bool isSharedEyeTarget() const { return mSharedEyeTarget; }
+
+			//! Stores the render model textures block-compressed (DXT1) when the driver supports it. Defaults to false.
+			Options& compressRenderModelTextures( bool enable = true ) { mCompressRenderModelTextures = enable; return *this; }
+			bool isCompressRenderModelTextures() const { return mCompressRenderModelTextures; }
+
+		private:
+			ci::fs::path	mCacheDirectory;
+			glm::ivec2		mLensGridSize;
+			bool			mPipelinedSubmit;
+			int				mMsaaSamples;
+			GLenum			mColorFormat;
+			GLenum			mDepthFormat;
+			int				mResolveBuffers;
+			bool			mSharedEyeTarget;
+			bool			mCompressRenderModelTextures;
+		};
+
+		static HtcViveRef create( const Options & options = Options() ) { return HtcViveRef{ new HtcVive{ options } }; }
 		~HtcVive();
 		void update();
 
+		//! Time per frame spent uploading newly loaded render models to GL, in milliseconds.
+		void setRenderModelUploadBudget( double ms ) { mRenderModelUploadBudgetMs = ms; }
+		double getRenderModelUploadBudget() const { return mRenderModelUploadBudgetMs; }
+
 		void bind();
 		void unbind();
 
 		void renderController( const vr::Hmd_Eye& eye );
-		void renderStereoTargets( std::function<void(vr::Hmd_Eye)> renderScene );
+		void renderStereoTargets( FunctionRef<void( vr::Hmd_Eye )> renderScene );
+		//! Renders both eyes with a single invocation of \a renderScene into a double-wide target.
+		//! Draws must be instanced with twice the instance count and use getSinglePassShaderPreamble() to place each instance in its eye.
+		void renderStereoTargetsSinglePass( FunctionRef<void()> renderScene );
 		void renderDistortion( const glm::ivec2& windowSize );
 
+		enum MirrorMode {
+			MIRROR_OFF,			//!< leaves the window untouched
+			MIRROR_LEFT_EYE,	//!< left eye, undistorted and scaled to fit the window
+			MIRROR_BOTH_EYES,	//!< both eyes side by side, undistorted and scaled to fit the window
+			MIRROR_DISTORTED	//!< both eyes through the lens distortion mesh, as renderDistortion()
+		};
+		//! Selects what renderMirror() draws. With an \a interval above 1 the mirror is only refreshed every interval-th
+		//! frame into a window-sized texture, and the frames in between just copy it. Defaults to MIRROR_DISTORTED every frame.
+		void setMirrorMode( MirrorMode mode, int interval = 1 );
+		MirrorMode getMirrorMode() const { return mMirrorMode; }
+		int getMirrorInterval() const { return mMirrorInterval; }
+		//! Draws the mirror selected by setMirrorMode() into the bound framebuffer, sized to \a windowSize.
+		void renderMirror( const glm::ivec2& windowSize );
+
 		const vr::IVRSystem * getHmd() const { return mHMD; }
+		//! Shared buffers and textures of the loaded render models.
+		const RenderModelBatch * getRenderModelBatch() const { return mRenderModelBatch.get(); }
+
+		//! Enables per-stage CPU/GPU frame timing, see getProfiler(). Disabled by default.
+		void enablePerfTiming( bool enable = true ) { mProfiler.setEnabled( enable ); }
+		bool isPerfTimingEnabled() const { return mProfiler.isEnabled(); }
+		const FrameProfiler & getProfiler() const { return mProfiler; }
+		//! State changes and GL calls issued by the library through its state cache each frame.
+		const GlStateCache & getGlState() const { return mGlState; }
+
+#if CINDER_VIVE_LATENCY_TRACKING
+		LatencyTracker & getLatencyTracker() { return mLatencyTracker; }
+		const LatencyTracker & getLatencyTracker() const { return mLatencyTracker; }
+#endif
+
+		//! Renders the eyes into a sub-rectangle of the render targets, sized from measured GPU time (see ResolutionScaler).
+		//! Must be called on the GL thread. Disabled by default.
+		void enableAdaptiveResolution( bool enable = true ) { mResolutionScaler.setEnabled( enable ); }
+		bool isAdaptiveResolutionEnabled() const { return mResolutionScaler.isEnabled(); }
+		ResolutionScaler & getResolutionScaler() { return mResolutionScaler; }
+
+		//! Culling against both eyes' frusta, updated from the poses in bind(). Use it from renderScene() so that the
+		//! tests of the first eye pass serve the second.
+		StereoCuller & getCuller() { return mCuller; }
+		const StereoCuller & getCuller() const { return mCuller; }
+		//! Size of each eye's viewport this frame; the render targets are allocated at the recommended size.
+		const glm::uvec2 & getViewportSize() const { return mViewportSize; }
+
+		//! Writes each eye's hidden-area mesh (the pixels the lens never shows) into the stencil buffer before its scene and
+		//! keeps the stencil test on during renderScene(), so those pixels are rejected before shading. Scenes that use the
+		//! stencil buffer themselves should leave this off. Disabled by default; enabling resets getHiddenAreaPixelsSavedEstimate().
+		void enableHiddenAreaMask( bool enable = true );
+		bool isHiddenAreaMaskEnabled() const { return mHiddenAreaMask; }
+		//! Pixels masked out since the mask was enabled, estimated from the mesh area and the masked viewport of every eye
+		//! pass. Not a measurement: it counts the masked pixels whether or not the scene would have drawn them.
+		uint64_t getHiddenAreaPixelsSavedEstimate() const { return mHiddenAreaPixelsSaved; }
+		//! Fraction of \a eye's image covered by the hidden-area mesh; 0 when the headset provides none.
+		float getHiddenAreaFraction( vr::Hmd_Eye eye ) const { return mHiddenAreaFraction[eye]; }
+
+		//! Renders each eye of renderStereoTargets() in two parts: the periphery at \a peripheralScale of the resolution into
+		//! a separate target that is then stretched over the eye, and a center rectangle at full resolution on top. The center
+		//! is centered on the lens axis and reaches \a radius of the eye's viewport to each side. The stencil buffer keeps
+		//! the periphery pass from shading the center, except for a one texel border that the stretched periphery blends
+		//! with; this needs a depth format with stencil, without one the periphery pass shades the whole eye. renderScene()
+		//! still runs, and submits its draws, twice per eye; its clears only touch the center during the second run. Ignored
+		//! with Options::sharedEyeTarget(); single-pass targets are rendered at full density. Stays off when the periphery
+		//! target cannot be created. Must be called on the GL thread. Disabled by default.
+		void enableFixedFoveation( bool enable = true, float radius = 0.3f, float peripheralScale = 0.5f );
+		bool isFixedFoveationEnabled() const { return mFoveation; }
+		float getFoveationRadius() const { return mFoveationRadius; }
+		float getFoveationPeripheralScale() const { return mFoveationScale; }
+
+		//! Uniform block binding point of the "ViveStereo" block during renderStereoTargetsSinglePass().
+		static const GLuint STEREO_UNIFORM_BINDING = 0;
+		//! Uniform block binding point of the "ViveEye" block during each eye of renderStereoTargets().
+		static const GLuint EYE_UNIFORM_BINDING = 1;
+		//! GLSL source (including the #version line) declaring the "ViveStereo" block and the viveStereo*() helpers for single-pass vertex shaders.
+		static std::string getSinglePassShaderPreamble();
+		//! GLSL source (including the #version line) declaring the "ViveEye" block for multi-pass shaders.
+		static std::string getMultiPassShaderPreamble();
+
+		//! Keeps a copy of every submitted frame so that a frame the app cannot deliver in time is replaced by the previous
+		//! one, rotated to the newest head pose. Needs direct submission, not Options::pipelinedSubmit(). Must be called on
+		//! the GL thread. Disabled by default.
+		void enableReprojection( bool enable = true );
+		bool isReprojectionEnabled() const { return mReprojection; }
+		//! Takes the place of bind() ... unbind() for a frame the app will miss: waits for the poses like bind() and submits
+		//! the last frame, rotated from the head pose it was rendered for to the new one. Does nothing, without waiting,
+		//! before the first frame was kept, and refuses to run with Options::pipelinedSubmit().
+		void reprojectFrame();
+		//! When the current frame is still being rendered \a ms after bind() got its poses, checkReprojectionWatchdog()
+		//! submits the last frame rotated to this frame's poses right away, so that the vsync the frame is about to miss
+		//! still gets a frame; unbind() then keeps the late frame as history only. Set it below the frame period, e.g.
+		//! 9 ms at 90 Hz, leaving time for the warp. 0 disables the watchdog, which is the default.
+		void setReprojectionWatchdog( double ms ) { mReprojectionWatchdogMs = ms; }
+		double getReprojectionWatchdog() const { return mReprojectionWatchdogMs; }
+		//! Checks the watchdog of setReprojectionWatchdog() and returns whether it submitted a reprojected frame. GL state is
+		//! left as it was. renderStereoTargets() and renderStereoTargetsSinglePass() check after each eye or pass; apps
+		//! with long render callbacks should also call it from within them.
+		bool checkReprojectionWatchdog();
+		uint64_t getFreshFrameCount() const { return mFreshFrames; }
+		uint64_t getReprojectedFrameCount() const { return mReprojectedFrames; }
+
+		//! Adds a layer of \a size pixels whose content \a render draws with window matrices (origin upper left). The
+		//! layer renders in bind() when it is new, marked dirty or due every \a updateInterval frames (0: only when dirty),
+		//! and is composited into each eye after the scene and the controllers. Layers with the same interval are spread
+		//! over different frames. Must be called on the GL thread.
+		LayerRef addLayer( const glm::ivec2 & size, const std::function<void()> & render, int updateInterval = 0 );
+		void removeLayer( const LayerRef & layer );
+		//! Layer renders during the last bind().
+		uint32_t getLayersRendered() const { return mLayersRendered; }
+
+		//! Seconds on the clock that DeviceMotion timestamps and prediction targets refer to.
+		double getTrackingTime() const { return mTrackingClock.getSeconds(); }
+		//! Motion of all devices from the last WaitGetPoses, timestamped at the photon time those poses were predicted for.
+		//! Belongs to the render thread; other threads should use getPoseHistory().
+		const DeviceMotionBatch & getDeviceMotion() const { return mDeviceMotion; }
+		//! Snapshots of getDeviceMotion() from recent frames, safe to sample from any thread.
+		const PoseHistory & getPoseHistory() const { return mPoseHistory; }
+		//! Predicts the device-to-tracking transform of \a device at \a time (see getTrackingTime()).
+		glm::mat4 predictDevicePose( vr::TrackedDeviceIndex_t device, double time ) const { return mDeviceMotion.get( device ).predict( time ); }
+		//! Predicts all device slots at \a time in one vectorized pass.
+		void predictDevicePoses( double time, std::array<glm::mat4, vr::k_unMaxTrackedDeviceCount> * poses ) const { mDeviceMotion.predict( time, poses->data() ); }
 
 		glm::mat4 getHMDMatrixProjectionEye( vr::Hmd_Eye nEye );
 		glm::mat4 getHMDMatrixPoseEye( vr::Hmd_Eye nEye );
@@ -71,27 +1150,46 @@ namespace hmd {
 		glm::mat4 convertSteamVRMatrixToMat4( const vr::HmdMatrix34_t &matPose );
 
 	private:
-		HtcVive();
+		HtcVive( const Options & options );
 
 		void setupShaders();
 		void setupStereoRenderTargets();
+		void setupSinglePassStereo();
+		void renderStereoTargetsShared( FunctionRef<void( vr::Hmd_Eye )> renderScene );
+		void renderMirrorContents( const glm::ivec2 & windowSize );
+		void drawMirrorQuad( GLuint texture, const glm::vec4 & rect, const glm::vec4 & uvRect );
 		void setupDistortion();
+		void setupHiddenAreaMesh();
+		//! \a pixelScale is the bound viewport's share of the eye viewport's pixels, for getHiddenAreaPixelsSavedEstimate().
+		void renderHiddenAreaStencil( vr::Hmd_Eye eye, float pixelScale = 1.0f );
+		void renderFoveatedPeriphery( vr::Hmd_Eye eye, FunctionRef<void( vr::Hmd_Eye )> renderScene );
+		void computeDistortion( const glm::ivec2 & gridSize, VertexDataLens * verts );
 		void setupCameras();
 		void setupRenderModels();
 		void setupRenderModelForTrackedDevice( vr::TrackedDeviceIndex_t unTrackedDeviceIndex );
 		void setupCompositor();
-
-		RenderModelRef findOrLoadRenderModel( const std::string& name );
+		std::unique_ptr<RenderTarget> createRenderTarget( const glm::ivec2 & size ) const;
+		void selectResolveBuffer( int buffer );
+		void getSubmitBounds( vr::VRTextureBounds_t * bounds ) const;
 
 		void processVREvent( const vr::VREvent_t & event );
 
-		std::string m_strPoseClasses;                            // what classes we saw poses for this frame
+		float getSecondsToPhotons() const;
+		void writePoseUniforms( const glm::mat4 & hmdView, const std::array<glm::mat4, vr::k_unMaxTrackedDeviceCount> & devicePose );
+
+		Options mOptions;
+
+		char m_strPoseClasses[vr::k_unMaxTrackedDeviceCount + 1]; // what classes we saw poses for this frame
 		char m_rDevClassChar[vr::k_unMaxTrackedDeviceCount];   // for each device, a character representing its class
 
 		float m_fNearClip;
 		float m_fFarClip;
 
-		bool mPerf;
+		FrameProfiler mProfiler;
+		GlStateCache mGlState;
+#if CINDER_VIVE_LATENCY_TRACKING
+		LatencyTracker mLatencyTracker;
+#endif
 		bool mVblank;
 		bool mGlFinishHack;
 
@@ -99,13 +1197,19 @@ namespace hmd {
 		vr::IVRRenderModels *	m_pRenderModels;
 		std::string				mDriver;
 		std::string				mDisplay;
+		float					mDisplayFrequency;
+		float					mSecondsFromVsyncToPhotons;
 
 		std::array<vr::TrackedDevicePose_t, vr::k_unMaxTrackedDeviceCount> mTrackedDevicePose;
 		std::array<glm::mat4, vr::k_unMaxTrackedDeviceCount> mDevicePose;
+		DeviceMotionBatch mDeviceMotion;
+		PoseHistory mPoseHistory;
+		ci::Timer mTrackingClock;
 		std::array<bool, vr::k_unMaxTrackedDeviceCount> mShowTrackedDevice;
 
 
-		GLuint m_unLensVAO;
+		ci::gl::VaoRef mLensVao;
+		GLuint mLensSampler;
 		GLuint m_glIDVertBuffer;
 		GLuint m_glIDIndexBuffer;
 		unsigned int m_uiIndexSize;
@@ -123,7 +1227,28 @@ namespace hmd {
 		glm::mat4 m_mat4ProjectionRight;
 
 		ci::gl::GlslProgRef mGlslLens;
-		ci::gl::GlslProgRef mGlslModel;
+		ci::gl::GlslProgRef mGlslHiddenArea;
+		ci::gl::GlslProgRef mGlslMirror;
+		GLint mMirrorRectLocation;
+		GLint mMirrorUvRectLocation;
+
+		MirrorMode		mMirrorMode;
+		int				mMirrorInterval;
+		uint32_t		mMirrorFrame;
+		ci::gl::FboRef	mMirrorFbo;
+
+		ci::gl::VboRef	mHiddenAreaVbo;
+		ci::gl::VaoRef	mHiddenAreaVao;
+		GLint			mHiddenAreaFirst[2];
+		GLsizei			mHiddenAreaCount[2];
+		float			mHiddenAreaFraction[2];
+		bool			mHiddenAreaMask;
+		uint64_t		mHiddenAreaPixelsSaved;
+
+		bool			mFoveation;
+		float			mFoveationRadius;
+		float			mFoveationScale;
+		std::unique_ptr<RenderTarget> mPeripheryTarget;
 
 		GLint m_nControllerMatrixLocation;
 
@@ -132,11 +1257,57 @@ namespace hmd {
 		int m_iValidPoseCount;
 		int m_iValidPoseCount_Last;
 
-		FramebufferDesc leftEyeDesc;
-		FramebufferDesc rightEyeDesc;
+		std::unique_ptr<RenderTarget> mEyeTargets[2];
 		glm::uvec2 mRenderSize;
+		glm::uvec2 mViewportSize;
+		ResolutionScaler mResolutionScaler;
+		StereoCuller mCuller;
+
+		std::unique_ptr<RenderTarget> mDoubleWideTarget;
+		// resolve texture of every target that this frame renders into, the same index is the compositor thread's slot
+		int mResolveBuffer;
+		int mNumResolveBuffers;
+
+		std::unique_ptr<CompositorThread> mCompositorThread;
+		bool mFrameIsDoubleWide;
+		GLint mLensUvScaleLocation;
+		GLint mLensUvOffsetLocation;
+
+		std::unique_ptr<PoseUniformBuffer> mPoseUniforms;
+
+		void captureReprojectionHistory( GLuint leftTexture, GLuint rightTexture, const vr::VRTextureBounds_t * bounds );
+		void submitReprojectedFrame();
+
+		bool				mReprojection;
+		double				mReprojectionWatchdogMs;
+		// the last fresh frame, each eye scaled to the whole texture, and the head pose it was rendered for
+		ci::gl::FboRef		mReprojectionHistory[2];
+		ci::gl::FboRef		mReprojectionOutput[2];
+		glm::mat4			mReprojectionView;
+		bool				mHasReprojectionHistory;
+		ci::gl::GlslProgRef	mGlslReproject;
+		GLint				mReprojectUnprojectLocation;
+		GLint				mReprojectReprojectLocation;
+		double				mFrameStartTime;		// tracking time of bind()'s poses, negative outside bind() ... unbind()
+		bool				mFrameReprojected;
+		uint64_t			mFreshFrames;
+		uint64_t			mReprojectedFrames;
+
+		void updateLayers();
+		//! Draws the layers with the view and projection matrices of the eye being rendered.
+		void renderLayers();
+
+		std::vector<LayerRef>	mLayers;
+		uint32_t				mLayerFrame;
+		uint32_t				mLayersRendered;
+
+		void gatherDeviceInstances();
 
-		std::vector<RenderModelRef> mRenderModels;
+		std::unique_ptr<RenderModelBatch> mRenderModelBatch;
+		std::unique_ptr<RenderModelLoader> mRenderModelLoader;
+		// devices drawn as coordinate frames this frame because their render model is still loading
+		std::vector<vr::TrackedDeviceIndex_t> mPlaceholderDevices;
+		double mRenderModelUploadBudgetMs;
 		std::array<RenderModelRef, vr::k_unMaxTrackedDeviceCount> mTrackedDeviceToRenderModel;
 
 	};
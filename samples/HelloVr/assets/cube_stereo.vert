@@ -0,0 +1,14 @@
+// The #version line and the ViveStereo block are prepended from hmd::HtcVive::getSinglePassShaderPreamble().
+
+uniform mat4	ciModelMatrix;
+
+in vec4		ciPosition;
+in vec2		ciTexCoord0;
+in vec3		vInstancePosition; // per-instance position variable, advanced once per stereo pair
+out highp vec2	TexCoord;
+
+void main( void )
+{
+	gl_Position	= viveStereoClipPosition( ciModelMatrix * ( ciPosition + vec4( vInstancePosition, 0 ) ) );
+	TexCoord	= ciTexCoord0;
+}
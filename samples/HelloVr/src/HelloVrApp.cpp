@@ -1,6 +1,7 @@
 #include "cinder/app/App.h"
 #include "cinder/app/RendererGl.h"
 #include "cinder/gl/gl.h"
+#include "cinder/Utilities.h"
 
 #include "CinderVive.h"
 
@@ -19,15 +20,39 @@ public:
 
 	void finishDraw();
 	void renderScene( vr::Hmd_Eye eye );
+	void renderSceneSinglePass();
 private:
 	hmd::HtcViveRef		mVive;
 
 	gl::Texture2dRef	mCubeTexture;
 	gl::BatchRef		mCubeBatch;
 	gl::GlslProgRef		mCubeGlsl;
+
+	bool				mSinglePass;
+	gl::BatchRef		mCubeStereoBatch;
+	gl::GlslProgRef		mCubeStereoGlsl;
+
+	// the same cubes drawn from the GPU culler's compacted instance list
+	bool				mGpuCulling;
+	std::unique_ptr<hmd::GpuInstanceCuller>	mCubeCuller;
+	gl::BatchRef		mCubeCulledBatch;
+	gl::BatchRef		mCubeCulledStereoBatch;
+
+	// the same cubes, moved every frame through the instance stream
+	bool				mAnimate;
+	std::vector<vec3>	mCubePositions;
+	std::unique_ptr<hmd::InstanceStream>	mCubeStream;
+	gl::BatchRef		mCubeStreamBatch;
+	gl::BatchRef		mCubeStreamStereoBatch;
+
+	// head-locked status panel, rendered about once a second instead of in every eye pass
+	hmd::LayerRef		mStatusLayer;
 };
 
 HelloVrApp::HelloVrApp()
+	: mSinglePass( false )
+	, mGpuCulling( false )
+	, mAnimate( false )
 {
 	auto rgl = static_cast<RendererGl *>(getWindow()->getRenderer().get());
 	rgl->setFinishDrawFn( std::bind( &HelloVrApp::finishDraw, this ) );
@@ -39,6 +64,18 @@ HelloVrApp::HelloVrApp()
 		CI_LOG_E( exc.what() );
 	}
 
+	if( mVive ) {
+		mStatusLayer = mVive->addLayer( ivec2( 512, 128 ), [this] {
+			gl::ScopedColor color( 0, 0, 0, 0.6f );
+			gl::drawSolidRect( Rectf( 0, 0, 512, 128 ) );
+			gl::drawString( toString( int( getAverageFps() + 0.5f ) ) + " fps, " + toString( mVive->getReprojectedFrameCount() ) + " reprojected",
+				vec2( 24, 44 ), Color::white(), Font( "Arial", 40 ) );
+		}, 90 );
+		mStatusLayer->setTransform( glm::scale( glm::translate( mat4(), vec3( 0, -0.3f, -1.2f ) ), vec3( 0.6f, 0.15f, 1 ) ), hmd::Layer::SPACE_HEAD );
+		mStatusLayer->setDepthTested( false );
+		mStatusLayer->setVisible( false );
+	}
+
 	GLfloat fLargest;
 	glGetFloatv( GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &fLargest );
 	gl::Texture2d::Format fmt;
@@ -67,6 +104,54 @@ HelloVrApp::HelloVrApp()
 	cubeMesh->appendVbo( instanceDataLayout, instanceDataVbo );
 
 	mCubeBatch = gl::Batch::create( cubeMesh, mCubeGlsl, { { geom::Attrib::CUSTOM_0, "vInstancePosition" } } );
+
+	// single-pass stereo draws every instance twice (once per eye), so positions advance every other instance
+	mCubeStereoGlsl = gl::GlslProg::create( gl::GlslProg::Format()
+		.vertex( hmd::HtcVive::getSinglePassShaderPreamble() + loadString( loadAsset( "cube_stereo.vert" ) ) )
+		.fragment( loadAsset( "cube.frag" ) ) );
+	mCubeStereoGlsl->uniform( "uTex0", 0 );
+	mCubeStereoGlsl->uniformBlock( "ViveStereo", hmd::HtcVive::STEREO_UNIFORM_BINDING );
+
+	auto cubeStereoMesh = gl::VboMesh::create( geom::Cube().size( vec3( 0.5 ) ) );
+	geom::BufferLayout instanceStereoDataLayout;
+	instanceStereoDataLayout.append( geom::Attrib::CUSTOM_0, 3, 0, 0, 2 /* per stereo instance pair */ );
+	cubeStereoMesh->appendVbo( instanceStereoDataLayout, instanceDataVbo );
+
+	mCubeStereoBatch = gl::Batch::create( cubeStereoMesh, mCubeStereoGlsl, { { geom::Attrib::CUSTOM_0, "vInstancePosition" } } );
+
+	// bounding spheres for GPU culling, the culled batches read the positions out of the compacted spheres
+	std::vector<vec4> spheres;
+	for( const auto & position : positions )
+		spheres.emplace_back( position, 0.25f * sqrt( 3.0f ) );
+	mCubeCuller.reset( new hmd::GpuInstanceCuller );
+	mCubeCuller->setInstances( spheres );
+
+	auto cubeCulledMesh = gl::VboMesh::create( geom::Cube().size( vec3( 0.5 ) ) );
+	geom::BufferLayout culledLayout;
+	culledLayout.append( geom::Attrib::CUSTOM_0, 3, sizeof( vec4 ), 0, 1 /* per instance */ );
+	cubeCulledMesh->appendVbo( culledLayout, mCubeCuller->getVisibleInstances() );
+	mCubeCulledBatch = gl::Batch::create( cubeCulledMesh, mCubeGlsl, { { geom::Attrib::CUSTOM_0, "vInstancePosition" } } );
+
+	auto cubeCulledStereoMesh = gl::VboMesh::create( geom::Cube().size( vec3( 0.5 ) ) );
+	geom::BufferLayout culledStereoLayout;
+	culledStereoLayout.append( geom::Attrib::CUSTOM_0, 3, sizeof( vec4 ), 0, 2 /* per stereo instance pair */ );
+	cubeCulledStereoMesh->appendVbo( culledStereoLayout, mCubeCuller->getVisibleInstances() );
+	mCubeCulledStereoBatch = gl::Batch::create( cubeCulledStereoMesh, mCubeStereoGlsl, { { geom::Attrib::CUSTOM_0, "vInstancePosition" } } );
+
+	mCubePositions = positions;
+	mCubeStream.reset( new hmd::InstanceStream( sizeof( vec3 ), (uint32_t)positions.size() ) );
+
+	auto cubeStreamMesh = gl::VboMesh::create( geom::Cube().size( vec3( 0.5 ) ) );
+	geom::BufferLayout streamLayout;
+	streamLayout.append( geom::Attrib::CUSTOM_0, 3, sizeof( vec3 ), 0, 1 /* per instance */ );
+	cubeStreamMesh->appendVbo( streamLayout, mCubeStream->getVbo() );
+	mCubeStreamBatch = gl::Batch::create( cubeStreamMesh, mCubeGlsl, { { geom::Attrib::CUSTOM_0, "vInstancePosition" } } );
+
+	auto cubeStreamStereoMesh = gl::VboMesh::create( geom::Cube().size( vec3( 0.5 ) ) );
+	geom::BufferLayout streamStereoLayout;
+	streamStereoLayout.append( geom::Attrib::CUSTOM_0, 3, sizeof( vec3 ), 0, 2 /* per stereo instance pair */ );
+	cubeStreamStereoMesh->appendVbo( streamStereoLayout, mCubeStream->getVbo() );
+	mCubeStreamStereoBatch = gl::Batch::create( cubeStreamStereoMesh, mCubeStereoGlsl, { { geom::Attrib::CUSTOM_0, "vInstancePosition" } } );
 }
 
 void HelloVrApp::renderScene( vr::Hmd_Eye eye )
@@ -74,7 +159,25 @@ void HelloVrApp::renderScene( vr::Hmd_Eye eye )
 	gl::clear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 	gl::ScopedDepth depth{ true };
 	gl::ScopedTextureBind tex0{ mCubeTexture, 0 };
-	mCubeBatch->drawInstanced( 21 * 21 * 21 );
+	if( mAnimate )
+		mCubeStream->draw( mCubeStreamBatch );
+	else if( mGpuCulling )
+		mCubeCuller->draw( mCubeCulledBatch );
+	else
+		mCubeBatch->drawInstanced( 21 * 21 * 21 );
+}
+
+void HelloVrApp::renderSceneSinglePass()
+{
+	gl::clear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+	gl::ScopedDepth depth{ true };
+	gl::ScopedTextureBind tex0{ mCubeTexture, 0 };
+	if( mAnimate )
+		mCubeStream->draw( mCubeStreamStereoBatch, 2 );
+	else if( mGpuCulling )
+		mCubeCuller->draw( mCubeCulledStereoBatch );
+	else
+		mCubeStereoBatch->drawInstanced( 2 * 21 * 21 * 21 );
 }
 
 
@@ -89,8 +192,23 @@ void HelloVrApp::draw()
 	gl::clear( Color( 0.15f, 0.15f, 0.18f ) );
 	if( mVive ) {
 		hmd::ScopedVive bind{ mVive };
-		mVive->renderStereoTargets( std::bind( &HelloVrApp::renderScene, this, std::placeholders::_1 ) );
-		mVive->renderDistortion( app::getWindowSize() );
+		if( mAnimate ) {
+			// a wave running through the grid, written straight into this frame's slice
+			float time = float( getElapsedSeconds() );
+			vec3 * positions = mCubeStream->beginFrame<vec3>();
+			for( const auto & position : mCubePositions )
+				*positions++ = position + vec3( 0, 0.5f * sin( 2.0f * time + 0.3f * ( position.x + position.z ) ), 0 );
+			mCubeStream->commit( (uint32_t)mCubePositions.size() );
+		}
+		else if( mGpuCulling )
+			mCubeCuller->cull( mVive->getCuller(), mSinglePass ? 2 : 1 );
+		if( mSinglePass )
+			mVive->renderStereoTargetsSinglePass( std::bind( &HelloVrApp::renderSceneSinglePass, this ) );
+		else
+			mVive->renderStereoTargets( std::bind( &HelloVrApp::renderScene, this, std::placeholders::_1 ) );
+		if( mAnimate )
+			mCubeStream->endFrame();
+		mVive->renderMirror( app::getWindowSize() );
 	}
 }
 
@@ -109,6 +227,68 @@ void HelloVrApp::keyDown( KeyEvent event )
 	if( event.getCode() == KeyEvent::KEY_ESCAPE ) {
 		quit();
 	}
+	else if( event.getChar() == 'p' && mVive ) {
+		// toggle frame timing, printing what was gathered when switching it off
+		if( mVive->isPerfTimingEnabled() ) {
+			const auto & profiler = mVive->getProfiler();
+			for( int stage = 0; stage < FrameProfiler::NUM_STAGES; ++stage ) {
+				auto cpu = profiler.getStats( (FrameProfiler::Stage)stage, false );
+				auto gpu = profiler.getStats( (FrameProfiler::Stage)stage, true );
+				CI_LOG_I( FrameProfiler::getStageName( (FrameProfiler::Stage)stage ) << " cpu avg " << cpu.avg << " p99 " << cpu.p99 << " | gpu avg " << gpu.avg << " p99 " << gpu.p99 );
+			}
+			CI_LOG_I( "GL calls through the state cache " << mVive->getGlState().getCachedCallsIssued() << ", redundant state changes skipped " << mVive->getGlState().getCachedCallsSkipped() );
+		}
+		mVive->enablePerfTiming( ! mVive->isPerfTimingEnabled() );
+	}
+	else if( event.getChar() == 's' ) {
+		mSinglePass = ! mSinglePass;
+		CI_LOG_I( "Single-pass stereo: " << ( mSinglePass ? "on" : "off" ) );
+	}
+	else if( event.getChar() == 'a' && mVive ) {
+		mVive->enableAdaptiveResolution( ! mVive->isAdaptiveResolutionEnabled() );
+		CI_LOG_I( "Adaptive resolution: " << ( mVive->isAdaptiveResolutionEnabled() ? "on" : "off" ) );
+	}
+	else if( event.getChar() == 'h' && mVive ) {
+		// report what the mask saved while it was on before switching it off
+		if( mVive->isHiddenAreaMaskEnabled() )
+			CI_LOG_I( "Hidden-area mask saved an estimated " << mVive->getHiddenAreaPixelsSavedEstimate() << " pixels" );
+		mVive->enableHiddenAreaMask( ! mVive->isHiddenAreaMaskEnabled() );
+		CI_LOG_I( "Hidden-area mask: " << ( mVive->isHiddenAreaMaskEnabled() ? "on" : "off" ) );
+	}
+	else if( event.getChar() == 'g' ) {
+		// benchmark toggle: compare the scene stages of 'p' with and without culling
+		if( mGpuCulling )
+			CI_LOG_I( "GPU culling drew " << mCubeCuller->readNumVisible() << " of " << mCubeCuller->getNumInstances() << " cubes last frame" );
+		mGpuCulling = ! mGpuCulling;
+		CI_LOG_I( "GPU culling: " << ( mGpuCulling ? "on" : "off" ) );
+	}
+	else if( event.getChar() == 'w' ) {
+		mAnimate = ! mAnimate;
+		CI_LOG_I( "Streamed wave animation: " << ( mAnimate ? "on" : "off" ) << ( mCubeStream->isPersistent() ? "" : " (without persistent mapping)" ) );
+	}
+	else if( event.getChar() == 'f' && mVive ) {
+		mVive->enableFixedFoveation( ! mVive->isFixedFoveationEnabled() );
+		CI_LOG_I( "Fixed foveation: " << ( mVive->isFixedFoveationEnabled() ? "on" : "off" ) );
+	}
+	else if( event.getChar() == 'r' && mVive ) {
+		// frames still rendering 9 ms after their poses get a reprojected frame in their place
+		if( mVive->isReprojectionEnabled() )
+			CI_LOG_I( "Frames: " << mVive->getFreshFrameCount() << " fresh, " << mVive->getReprojectedFrameCount() << " reprojected" );
+		mVive->enableReprojection( ! mVive->isReprojectionEnabled() );
+		mVive->setReprojectionWatchdog( mVive->isReprojectionEnabled() ? 9.0 : 0.0 );
+		CI_LOG_I( "Reprojection: " << ( mVive->isReprojectionEnabled() ? "on" : "off" ) );
+	}
+	else if( event.getChar() == 'u' && mVive ) {
+		mStatusLayer->setVisible( ! mStatusLayer->isVisible() );
+		CI_LOG_I( "Status layer: " << ( mStatusLayer->isVisible() ? "on" : "off" ) << ", rendered " << mStatusLayer->getRenderCount() << " times so far" );
+	}
+	else if( event.getChar() == 'm' && mVive ) {
+		// cycle through the mirror modes, refreshing the undistorted ones every 4th frame
+		auto mode = static_cast<hmd::HtcVive::MirrorMode>( ( mVive->getMirrorMode() + 1 ) % ( hmd::HtcVive::MIRROR_DISTORTED + 1 ) );
+		mVive->setMirrorMode( mode, mode == hmd::HtcVive::MIRROR_DISTORTED ? 1 : 4 );
+		const char * names[] = { "off", "left eye", "both eyes", "distorted" };
+		CI_LOG_I( "Mirror: " << names[mode] << ", every " << mVive->getMirrorInterval() << " frame(s)" );
+	}
 }
 
 void prepareSettings( App::Settings* settings )
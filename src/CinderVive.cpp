@@ -1,59 +1,2306 @@
 #include "CinderVive.h"
 
+#include "cinder/Thread.h"
+#include "cinder/Timer.h"
+#include "cinder/Utilities.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <fstream>
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+#include <emmintrin.h>
+#define CINDER_VIVE_SSE 1
+#endif
+
 using namespace ci;
 using namespace std;
 using namespace hmd;
 
-std::string GetTrackedDeviceString( vr::IVRSystem *pHmd, vr::TrackedDeviceIndex_t unDevice, vr::TrackedDeviceProperty prop, vr::TrackedPropertyError *peError = NULL )
+#if CINDER_VIVE_LATENCY_TRACKING
+	#define LATENCY_MARK( call ) mLatencyTracker.call
+#else
+	#define LATENCY_MARK( call )
+#endif
+
+std::string GetTrackedDeviceString( vr::IVRSystem *pHmd, vr::TrackedDeviceIndex_t unDevice, vr::TrackedDeviceProperty prop, vr::TrackedPropertyError *peError = NULL )
+{
+	// typical properties fit a fixed buffer in one call; the length returned includes the terminator
+	char pchBuffer[256];
+	uint32_t unRequiredBufferLen = pHmd->GetStringTrackedDeviceProperty( unDevice, prop, pchBuffer, sizeof( pchBuffer ), peError );
+	if( unRequiredBufferLen == 0 )
+		return "";
+	if( unRequiredBufferLen <= sizeof( pchBuffer ) )
+		return std::string( pchBuffer, unRequiredBufferLen - 1 );
+
+	std::string sResult( unRequiredBufferLen, '\0' );
+	unRequiredBufferLen = pHmd->GetStringTrackedDeviceProperty( unDevice, prop, &sResult[0], unRequiredBufferLen, peError );
+	sResult.resize( unRequiredBufferLen ? unRequiredBufferLen - 1 : 0 );
+	return sResult;
+}
+
+bool IsGlVersionOrExtension( int requiredMajor, int requiredMinor, const char * extension )
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv( GL_MAJOR_VERSION, &major );
+	glGetIntegerv( GL_MINOR_VERSION, &minor );
+	return major > requiredMajor || ( major == requiredMajor && minor >= requiredMinor ) || gl::isExtensionAvailable( extension );
+}
+
+// Render model cache files hold a header followed by the quantized interleaved vertices, the reordered 16-bit
+// indices and an RGBA8 mip chain, each section 16-byte aligned so it can be uploaded straight from the mapping.
+// Bump RENDER_MODEL_CACHE_VERSION whenever the layout or the processing changes.
+const uint32_t RENDER_MODEL_CACHE_MAGIC = 0x4D525643; // "CVRM"
+const uint32_t RENDER_MODEL_CACHE_VERSION = 2;
+
+struct RenderModelCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t runtimeHash;
+	uint32_t vertexCount;
+	uint32_t vertexOffset;
+	uint32_t indexCount;
+	uint32_t indexOffset;
+	uint16_t textureWidth;
+	uint16_t textureHeight;
+	uint32_t textureLevelCount;
+	uint32_t textureOffset;
+	uint32_t totalSize;
+	uint32_t sourceSize;
+};
+
+uint64_t HashString( const std::string & str )
+{
+	// 64-bit FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for( char c : str ) {
+		hash ^= (uint8_t)c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+size_t AlignCacheOffset( size_t offset )
+{
+	return ( offset + 15 ) & ~(size_t)15;
+}
+
+size_t MipLevelSize( uint16_t width, uint16_t height, uint32_t level )
+{
+	return std::max( 1, width >> level ) * std::max( 1, height >> level ) * 4;
+}
+
+uint32_t MipLevelCount( uint16_t width, uint16_t height )
+{
+	uint32_t count = 1;
+	while( ( width >> count ) > 0 || ( height >> count ) > 0 )
+		++count;
+	return count;
+}
+
+void DownsampleRgba( const uint8_t * src, int srcWidth, int srcHeight, uint8_t * dst, int dstWidth, int dstHeight )
+{
+	// 2x2 box filter, clamping at the edges of odd-sized levels
+	for( int y = 0; y < dstHeight; ++y ) {
+		const uint8_t * row0 = src + 4 * srcWidth * std::min( 2 * y, srcHeight - 1 );
+		const uint8_t * row1 = src + 4 * srcWidth * std::min( 2 * y + 1, srcHeight - 1 );
+		for( int x = 0; x < dstWidth; ++x ) {
+			int x0 = 4 * std::min( 2 * x, srcWidth - 1 );
+			int x1 = 4 * std::min( 2 * x + 1, srcWidth - 1 );
+			for( int c = 0; c < 4; ++c ) {
+				*dst++ = (uint8_t)( ( row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2 ) / 4 );
+			}
+		}
+	}
+}
+
+const int VERTEX_CACHE_SIZE = 32;
+const uint32_t OVERDRAW_CLUSTER_TRIANGLES = 64;
+
+float VertexCacheScore( int cachePosition, uint32_t remainingTriangles )
+{
+	if( remainingTriangles == 0 )
+		return -1.0f;
+
+	// Forsyth's weights: the last triangle's vertices score alike, older entries fade out, and vertices with
+	// few triangles left are favored so that they leave the mesh early
+	float score = 0.0f;
+	if( cachePosition >= 0 ) {
+		if( cachePosition < 3 )
+			score = 0.75f;
+		else
+			score = std::pow( 1.0f - float( cachePosition - 3 ) / ( VERTEX_CACHE_SIZE - 3 ), 1.5f );
+	}
+	return score + 2.0f / std::sqrt( float( remainingTriangles ) );
+}
+
+//! Reorders triangles for the post-transform vertex cache (Forsyth's linear-speed optimizer).
+void OptimizeVertexCache( std::vector<uint16_t> & indices, uint32_t vertexCount )
+{
+	uint32_t triangleCount = (uint32_t)indices.size() / 3;
+
+	std::vector<uint32_t> remaining( vertexCount, 0 );
+	for( auto index : indices )
+		++remaining[index];
+	std::vector<uint32_t> adjacencyOffset( vertexCount + 1, 0 );
+	for( uint32_t v = 0; v < vertexCount; ++v )
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+	std::vector<uint32_t> adjacency( indices.size() );
+	std::vector<uint32_t> fill( adjacencyOffset.begin(), adjacencyOffset.end() - 1 );
+	for( size_t i = 0; i < indices.size(); ++i )
+		adjacency[fill[indices[i]]++] = (uint32_t)i / 3;
+
+	std::vector<int> cachePosition( vertexCount, -1 );
+	std::vector<float> vertexScore( vertexCount );
+	for( uint32_t v = 0; v < vertexCount; ++v )
+		vertexScore[v] = VertexCacheScore( -1, remaining[v] );
+
+	std::vector<bool> emitted( triangleCount, false );
+	std::vector<uint16_t> output;
+	output.reserve( indices.size() );
+	std::vector<uint16_t> cache, newCache;
+	uint32_t scanPosition = 0;
+	int best = -1;
+	for( uint32_t n = 0; n < triangleCount; ++n ) {
+		if( best < 0 ) {
+			// dead end: nothing in the cache has triangles left, restart at the next triangle in input order
+			while( emitted[scanPosition] )
+				++scanPosition;
+			best = (int)scanPosition;
+		}
+
+		emitted[best] = true;
+		const uint16_t * triangle = &indices[3 * best];
+		newCache.assign( triangle, triangle + 3 );
+		for( int c = 0; c < 3; ++c ) {
+			uint16_t v = triangle[c];
+			output.push_back( v );
+			// the adjacency of each vertex only keeps the triangles still to be emitted
+			uint32_t * first = &adjacency[adjacencyOffset[v]];
+			uint32_t * last = first + remaining[v] - 1;
+			*std::find( first, last + 1, (uint32_t)best ) = *last;
+			--remaining[v];
+		}
+		for( auto v : cache ) {
+			if( v != triangle[0] && v != triangle[1] && v != triangle[2] )
+				newCache.push_back( v );
+		}
+		for( size_t i = 0; i < newCache.size(); ++i ) {
+			uint16_t v = newCache[i];
+			cachePosition[v] = i < VERTEX_CACHE_SIZE ? (int)i : -1;
+			vertexScore[v] = VertexCacheScore( cachePosition[v], remaining[v] );
+		}
+
+		best = -1;
+		float bestScore = 0.0f;
+		for( auto v : newCache ) {
+			for( uint32_t a = 0; a < remaining[v]; ++a ) {
+				uint32_t t = adjacency[adjacencyOffset[v] + a];
+				float score = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+				if( best < 0 || score > bestScore ) {
+					best = (int)t;
+					bestScore = score;
+				}
+			}
+		}
+
+		if( newCache.size() > VERTEX_CACHE_SIZE )
+			newCache.resize( VERTEX_CACHE_SIZE );
+		cache.swap( newCache );
+	}
+
+	indices.swap( output );
+}
+
+//! Orders fixed-size clusters of the cache-optimized triangles so that those facing away from the model's center
+//! come first and occlude the inner ones (after Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+void OptimizeOverdraw( std::vector<uint16_t> & indices, const std::vector<vr::RenderModel_Vertex_t> & vertices )
+{
+	auto position = [&]( uint16_t index ) {
+		const auto & v = vertices[index].vPosition.v;
+		return vec3( v[0], v[1], v[2] );
+	};
+
+	vec3 center( 0.0f );
+	for( auto index : indices )
+		center += position( index );
+	center /= float( std::max<size_t>( indices.size(), 1 ) );
+
+	uint32_t triangleCount = (uint32_t)indices.size() / 3;
+	std::vector<std::pair<float, uint32_t>> clusters;
+	for( uint32_t first = 0; first < triangleCount; first += OVERDRAW_CLUSTER_TRIANGLES ) {
+		uint32_t last = std::min( first + OVERDRAW_CLUSTER_TRIANGLES, triangleCount );
+		vec3 normal( 0.0f ), centroid( 0.0f );
+		float area = 0.0f;
+		for( uint32_t t = first; t < last; ++t ) {
+			vec3 p0 = position( indices[3 * t] ), p1 = position( indices[3 * t + 1] ), p2 = position( indices[3 * t + 2] );
+			vec3 n = glm::cross( p1 - p0, p2 - p0 );
+			float a = glm::length( n );
+			normal += n;
+			centroid += ( p0 + p1 + p2 ) * ( a / 3.0f );
+			area += a;
+		}
+		float outward = 0.0f;
+		if( area > 0.0f && glm::length( normal ) > 0.0f )
+			outward = glm::dot( centroid / area - center, glm::normalize( normal ) );
+		clusters.emplace_back( outward, first );
+	}
+	std::stable_sort( clusters.begin(), clusters.end(), []( const std::pair<float, uint32_t> & a, const std::pair<float, uint32_t> & b ) {
+		return a.first > b.first;
+	} );
+
+	std::vector<uint16_t> output;
+	output.reserve( indices.size() );
+	for( const auto & cluster : clusters ) {
+		uint32_t last = std::min( cluster.second + OVERDRAW_CLUSTER_TRIANGLES, triangleCount );
+		output.insert( output.end(), indices.begin() + 3 * cluster.second, indices.begin() + 3 * last );
+	}
+	indices.swap( output );
+}
+
+//! Renumbers the vertices in the order the indices first use them, dropping unused ones, so that vertex fetches run linearly.
+std::vector<vr::RenderModel_Vertex_t> OptimizeVertexFetch( std::vector<uint16_t> & indices, const vr::RenderModel_Vertex_t * vertices, uint32_t vertexCount )
+{
+	std::vector<int> remap( vertexCount, -1 );
+	std::vector<vr::RenderModel_Vertex_t> output;
+	for( auto & index : indices ) {
+		if( remap[index] < 0 ) {
+			remap[index] = (int)output.size();
+			output.push_back( vertices[index] );
+		}
+		index = (uint16_t)remap[index];
+	}
+	return output;
+}
+
+uint16_t FloatToHalf( float value )
+{
+	uint32_t bits;
+	memcpy( &bits, &value, sizeof( bits ) );
+	uint16_t sign = uint16_t( ( bits >> 16 ) & 0x8000 );
+	int exponent = int( ( bits >> 23 ) & 0xff ) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+	if( exponent <= 0 )
+		return sign; // flush denormals to zero, far below the millimeter scale of render models
+	if( exponent >= 31 )
+		return uint16_t( sign | 0x7c00 );
+	// round to nearest
+	uint32_t half = ( uint32_t( exponent ) << 10 ) | ( mantissa >> 13 );
+	half += ( mantissa >> 12 ) & 1;
+	return uint16_t( sign | std::min<uint32_t>( half, 0x7bff ) );
+}
+
+int16_t FloatToSnorm16( float value )
+{
+	return (int16_t)std::round( glm::clamp( value, -1.0f, 1.0f ) * 32767.0f );
+}
+
+uint16_t FloatToUnorm16( float value )
+{
+	return (uint16_t)std::round( glm::clamp( value, 0.0f, 1.0f ) * 65535.0f );
+}
+
+PackedRenderModelVertex PackRenderModelVertex( const vr::RenderModel_Vertex_t & vertex )
+{
+	PackedRenderModelVertex packed;
+	for( int i = 0; i < 3; ++i )
+		packed.position[i] = FloatToHalf( vertex.vPosition.v[i] );
+	packed.position[3] = FloatToHalf( 1.0f );
+
+	// octahedral encoding: project onto the octahedron, then fold the lower hemisphere over the diagonals
+	const float * n = vertex.vNormal.v;
+	float l1 = std::abs( n[0] ) + std::abs( n[1] ) + std::abs( n[2] );
+	float x = l1 > 0.0f ? n[0] / l1 : 0.0f;
+	float y = l1 > 0.0f ? n[1] / l1 : 0.0f;
+	if( n[2] < 0.0f ) {
+		float foldedX = ( 1.0f - std::abs( y ) ) * ( x >= 0.0f ? 1.0f : -1.0f );
+		float foldedY = ( 1.0f - std::abs( x ) ) * ( y >= 0.0f ? 1.0f : -1.0f );
+		x = foldedX;
+		y = foldedY;
+	}
+	packed.normal[0] = FloatToSnorm16( x );
+	packed.normal[1] = FloatToSnorm16( y );
+
+	// the batch samples a clamped corner of an array layer, so coordinates outside [0, 1] are clamped
+	packed.texCoord[0] = FloatToUnorm16( vertex.rfTextureCoord[0] );
+	packed.texCoord[1] = FloatToUnorm16( vertex.rfTextureCoord[1] );
+	return packed;
+}
+
+std::vector<uint8_t> BuildRenderModelCacheBlob( const vr::RenderModel_t & vrModel, const vr::RenderModel_TextureMap_t & vrTexture, uint64_t runtimeHash )
+{
+	std::vector<uint16_t> indices( vrModel.rIndexData, vrModel.rIndexData + vrModel.unTriangleCount * 3 );
+	OptimizeVertexCache( indices, vrModel.unVertexCount );
+	std::vector<vr::RenderModel_Vertex_t> vertices = OptimizeVertexFetch( indices, vrModel.rVertexData, vrModel.unVertexCount );
+	OptimizeOverdraw( indices, vertices );
+
+	RenderModelCacheHeader header;
+	header.magic = RENDER_MODEL_CACHE_MAGIC;
+	header.version = RENDER_MODEL_CACHE_VERSION;
+	header.runtimeHash = runtimeHash;
+	header.vertexCount = (uint32_t)vertices.size();
+	header.vertexOffset = (uint32_t)AlignCacheOffset( sizeof( RenderModelCacheHeader ) );
+	header.indexCount = (uint32_t)indices.size();
+	header.indexOffset = (uint32_t)AlignCacheOffset( header.vertexOffset + header.vertexCount * sizeof( PackedRenderModelVertex ) );
+	header.textureWidth = vrTexture.unWidth;
+	header.textureHeight = vrTexture.unHeight;
+	header.textureLevelCount = MipLevelCount( vrTexture.unWidth, vrTexture.unHeight );
+	header.textureOffset = (uint32_t)AlignCacheOffset( header.indexOffset + header.indexCount * sizeof( uint16_t ) );
+
+	size_t textureSize = 0;
+	for( uint32_t level = 0; level < header.textureLevelCount; ++level )
+		textureSize += MipLevelSize( header.textureWidth, header.textureHeight, level );
+	header.totalSize = (uint32_t)( header.textureOffset + textureSize );
+	header.sourceSize = (uint32_t)( vrModel.unVertexCount * sizeof( vr::RenderModel_Vertex_t ) + header.indexCount * sizeof( uint16_t )
+		+ MipLevelSize( header.textureWidth, header.textureHeight, 0 ) );
+
+	std::vector<uint8_t> blob( header.totalSize, 0 );
+	memcpy( blob.data(), &header, sizeof( header ) );
+	auto packed = reinterpret_cast<PackedRenderModelVertex *>( blob.data() + header.vertexOffset );
+	for( const auto & vertex : vertices )
+		*packed++ = PackRenderModelVertex( vertex );
+	memcpy( blob.data() + header.indexOffset, indices.data(), header.indexCount * sizeof( uint16_t ) );
+
+	uint8_t * level = blob.data() + header.textureOffset;
+	memcpy( level, vrTexture.rubTextureMapData, MipLevelSize( header.textureWidth, header.textureHeight, 0 ) );
+	for( uint32_t l = 1; l < header.textureLevelCount; ++l ) {
+		uint8_t * nextLevel = level + MipLevelSize( header.textureWidth, header.textureHeight, l - 1 );
+		DownsampleRgba( level, std::max( 1, header.textureWidth >> ( l - 1 ) ), std::max( 1, header.textureHeight >> ( l - 1 ) ),
+			nextLevel, std::max( 1, header.textureWidth >> l ), std::max( 1, header.textureHeight >> l ) );
+		level = nextLevel;
+	}
+
+	return blob;
+}
+
+RenderModelDataRef ViewRenderModelCacheBlob( const uint8_t * blob, size_t size, uint64_t runtimeHash )
+{
+	if( size < sizeof( RenderModelCacheHeader ) )
+		return nullptr;
+
+	RenderModelCacheHeader header;
+	memcpy( &header, blob, sizeof( header ) );
+	if( header.magic != RENDER_MODEL_CACHE_MAGIC || header.version != RENDER_MODEL_CACHE_VERSION || header.runtimeHash != runtimeHash || header.totalSize != size )
+		return nullptr;
+
+	size_t textureSize = 0;
+	for( uint32_t level = 0; level < header.textureLevelCount; ++level )
+		textureSize += MipLevelSize( header.textureWidth, header.textureHeight, level );
+	if( (size_t)header.vertexOffset + header.vertexCount * sizeof( PackedRenderModelVertex ) > size
+		|| (size_t)header.indexOffset + header.indexCount * sizeof( uint16_t ) > size
+		|| (size_t)header.textureOffset + textureSize > size )
+		return nullptr;
+
+	auto data = std::make_shared<RenderModelData>();
+	data->vertices = reinterpret_cast<const PackedRenderModelVertex *>( blob + header.vertexOffset );
+	data->vertexCount = header.vertexCount;
+	data->indices = reinterpret_cast<const uint16_t *>( blob + header.indexOffset );
+	data->indexCount = header.indexCount;
+	data->textureLevels = blob + header.textureOffset;
+	data->textureWidth = header.textureWidth;
+	data->textureHeight = header.textureHeight;
+	data->textureLevelCount = header.textureLevelCount;
+	data->sourceSize = header.sourceSize;
+	return data;
+}
+
+struct MappedRenderModelCache
+{
+	MappedRenderModelCache( const fs::path & path )
+		: file( path.string().c_str(), boost::interprocess::read_only )
+		, region( file, boost::interprocess::read_only )
+	{
+	}
+
+	boost::interprocess::file_mapping	file;
+	boost::interprocess::mapped_region	region;
+};
+
+RenderModelDataRef MapRenderModelCache( const fs::path & path, uint64_t runtimeHash )
+{
+	if( ! fs::exists( path ) )
+		return nullptr;
+
+	try {
+		auto mapping = std::make_shared<MappedRenderModelCache>( path );
+		auto data = ViewRenderModelCacheBlob( static_cast<const uint8_t *>( mapping->region.get_address() ), mapping->region.get_size(), runtimeHash );
+		if( data )
+			data->storage = mapping;
+		return data;
+	}
+	catch( const boost::interprocess::interprocess_exception & exc ) {
+		CI_LOG_W( "Unable to map render model cache " << path.string() << ": " << exc.what() );
+	}
+	return nullptr;
+}
+
+bool WriteCacheFile( const fs::path & path, const std::vector<uint8_t> & blob )
+{
+	// write next to the target first so that an interrupted write never leaves a truncated entry behind
+	fs::path tmpPath = path.string() + ".tmp";
+	{
+		std::ofstream out( tmpPath.string().c_str(), std::ios::binary | std::ios::trunc );
+		out.write( reinterpret_cast<const char *>( blob.data() ), blob.size() );
+		if( ! out )
+			return false;
+	}
+
+	try {
+		if( fs::exists( path ) )
+			fs::remove( path );
+		fs::rename( tmpPath, path );
+	}
+	catch( const std::exception & exc ) {
+		CI_LOG_W( "Unable to write cache file " << path.string() << ": " << exc.what() );
+		return false;
+	}
+	return true;
+}
+
+std::string SanitizeFileName( std::string name )
+{
+	for( char & c : name ) {
+		if( ! isalnum( (unsigned char)c ) && c != '_' && c != '-' && c != '.' )
+			c = '_';
+	}
+	return name;
+}
+
+// Lens distortion cache files hold a header followed by the vertices of both eyes.
+const uint32_t LENS_CACHE_MAGIC = 0x444C5643; // "CVLD"
+const uint32_t LENS_CACHE_VERSION = 1;
+
+struct LensCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t keyHash;
+	uint32_t vertexCount;
+	uint32_t reserved;
+};
+
+bool ReadLensCache( const fs::path & path, uint64_t keyHash, std::vector<VertexDataLens> & verts )
+{
+	std::ifstream in( path.string().c_str(), std::ios::binary );
+	if( ! in )
+		return false;
+
+	LensCacheHeader header;
+	in.read( reinterpret_cast<char *>( &header ), sizeof( header ) );
+	if( ! in || header.magic != LENS_CACHE_MAGIC || header.version != LENS_CACHE_VERSION || header.keyHash != keyHash || header.vertexCount != verts.size() )
+		return false;
+
+	in.read( reinterpret_cast<char *>( verts.data() ), verts.size() * sizeof( VertexDataLens ) );
+	return !! in;
+}
+
+bool WriteLensCache( const fs::path & path, uint64_t keyHash, const std::vector<VertexDataLens> & verts )
+{
+	LensCacheHeader header = { LENS_CACHE_MAGIC, LENS_CACHE_VERSION, keyHash, (uint32_t)verts.size(), 0 };
+	std::vector<uint8_t> blob( sizeof( header ) + verts.size() * sizeof( VertexDataLens ) );
+	memcpy( blob.data(), &header, sizeof( header ) );
+	memcpy( blob.data() + sizeof( header ), verts.data(), verts.size() * sizeof( VertexDataLens ) );
+	return WriteCacheFile( path, blob );
+}
+
+const int RenderModelBatch::LAYER_SIZE;
+const int RenderModelBatch::NUM_LAYER_LEVELS;
+
+RenderModelBatch::RenderModelBatch( bool compressTextures )
+	: mTexture( 0 )
+	, mNumLayers( 0 )
+	, mMultiDrawIndirect( IsGlVersionOrExtension( 4, 3, "GL_ARB_multi_draw_indirect" ) )
+	, mCompressed( compressTextures && gl::isExtensionAvailable( "GL_EXT_texture_compression_s3tc" ) )
+	, mNumVertices( 0 )
+	, mNumIndices( 0 )
+	, mInstancesUploaded( false )
+{
+	mGlsl = gl::GlslProg::create(
+		"#version 410 core\n"
+		"uniform mat4 viewProjection;\n"
+		"layout(location = 0) in vec3 position;\n"
+		"layout(location = 2) in vec2 texCoord;\n"
+		"layout(location = 3) in mat4 instanceTransform;\n"
+		"layout(location = 7) in vec4 instanceTexture;\n"
+		"out vec3 vTexCoord;\n"
+		"void main()\n"
+		"{\n"
+		"	vTexCoord = vec3( texCoord * instanceTexture.xy, instanceTexture.z );\n"
+		"	gl_Position = viewProjection * instanceTransform * vec4( position, 1.0 );\n"
+		"}\n"
+		,
+		"#version 410 core\n"
+		"uniform sampler2DArray diffuse;\n"
+		"in vec3 vTexCoord;\n"
+		"out vec4 outputColor;\n"
+		"void main()\n"
+		"{\n"
+		"	outputColor = texture( diffuse, vTexCoord );\n"
+		"}\n" );
+	mGlsl->uniform( "diffuse", 0 );
+
+	if( compressTextures && ! mCompressed ) {
+		CI_LOG_W( "EXT_texture_compression_s3tc is not available, render model textures stay uncompressed" );
+	}
+
+	mVertices = gl::Vbo::create( GL_ARRAY_BUFFER, 0, nullptr, GL_STATIC_DRAW );
+	mIndices = gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, 0, nullptr, GL_STATIC_DRAW );
+	mInstanceVbo = gl::Vbo::create( GL_ARRAY_BUFFER, vr::k_unMaxTrackedDeviceCount * sizeof( Instance ), nullptr, GL_STREAM_DRAW );
+	mSingleInstanceVbo = gl::Vbo::create( GL_ARRAY_BUFFER, sizeof( Instance ), nullptr, GL_STREAM_DRAW );
+	mIndirectVbo = gl::Vbo::create( GL_DRAW_INDIRECT_BUFFER, vr::k_unMaxTrackedDeviceCount * sizeof( DrawCommand ), nullptr, GL_STREAM_DRAW );
+
+	mVao = gl::Vao::create();
+	mSingleVao = gl::Vao::create();
+	setupVao( mVao, mInstanceVbo );
+	setupVao( mSingleVao, mSingleInstanceVbo );
+}
+
+RenderModelBatch::~RenderModelBatch()
+{
+	glDeleteTextures( 1, &mTexture );
+}
+
+void RenderModelBatch::setupVao( const gl::VaoRef & vao, const gl::VboRef & instances )
+{
+	// the buffers are refilled in place as models are added, so the attributes never need to be pointed again
+	gl::ScopedVao scopedVao{ vao };
+	{
+		gl::ScopedBuffer scopedVertices{ mVertices };
+		gl::enableVertexAttribArray( 0 );
+		gl::vertexAttribPointer( 0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof( PackedRenderModelVertex ), (const void *)offsetof( PackedRenderModelVertex, position ) );
+		gl::enableVertexAttribArray( 2 );
+		gl::vertexAttribPointer( 2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof( PackedRenderModelVertex ), (const void *)offsetof( PackedRenderModelVertex, texCoord ) );
+	}
+	gl::ScopedBuffer scopedInstances{ instances };
+	for( GLuint location = 3; location <= 7; ++location ) {
+		gl::enableVertexAttribArray( location );
+		gl::vertexAttribDivisor( location, 1 );
+	}
+	pointInstanceAttribs( 0 );
+	mIndices->bind();
+}
+
+void RenderModelBatch::pointInstanceAttribs( size_t offset )
+{
+	for( GLuint column = 0; column < 4; ++column ) {
+		gl::vertexAttribPointer( 3 + column, 4, GL_FLOAT, GL_FALSE, sizeof( Instance ), (const void *)( offset + offsetof( Instance, transform ) + column * sizeof( vec4 ) ) );
+	}
+	gl::vertexAttribPointer( 7, 4, GL_FLOAT, GL_FALSE, sizeof( Instance ), (const void *)( offset + offsetof( Instance, texture ) ) );
+}
+
+int RenderModelBatch::addGeometry( const RenderModelDataRef & data )
+{
+	Model model = { data, mNumIndices, (GLint)mNumVertices, vec2( 1 ), false, data->vertexCount * sizeof( PackedRenderModelVertex ) + data->indexCount * sizeof( uint16_t ) };
+	mModels.push_back( model );
+	mNumVertices += data->vertexCount;
+	mNumIndices += data->indexCount;
+
+	// geometry is small next to the textures, so the buffers are simply refilled with every model
+	mVertices->bufferData( mNumVertices * sizeof( PackedRenderModelVertex ), nullptr, GL_STATIC_DRAW );
+	mIndices->bufferData( mNumIndices * sizeof( uint16_t ), nullptr, GL_STATIC_DRAW );
+	for( const auto & m : mModels ) {
+		mVertices->bufferSubData( m.baseVertex * sizeof( PackedRenderModelVertex ), m.data->vertexCount * sizeof( PackedRenderModelVertex ), m.data->vertices );
+		mIndices->bufferSubData( m.firstIndex * sizeof( uint16_t ), m.data->indexCount * sizeof( uint16_t ), m.data->indices );
+	}
+
+	return (int)mModels.size() - 1;
+}
+
+void RenderModelBatch::addTexture( int slot )
+{
+	if( slot >= mNumLayers ) {
+		allocateLayers( std::max( { slot + 1, 2 * mNumLayers, 4 } ) );
+	}
+	uploadLayer( slot );
+
+	Model & model = mModels[slot];
+	model.textureDone = true;
+	model.gpuSize += getLayerBytes();
+	CI_LOG_I( "Render model " << model.data->name << ": " << model.data->sourceSize << " bytes from the runtime, " << model.gpuSize << " on the GPU, "
+		<< getBytesSaved( slot ) << " saved" );
+}
+
+size_t RenderModelBatch::getLayerBytes() const
+{
+	size_t bytes = 0;
+	for( int level = 0; level < NUM_LAYER_LEVELS; ++level ) {
+		size_t size = LAYER_SIZE >> level;
+		// DXT1 packs each 4x4 block into 8 bytes
+		bytes += mCompressed ? ( ( size + 3 ) / 4 ) * ( ( size + 3 ) / 4 ) * 8 : size * size * 4;
+	}
+	return bytes;
+}
+
+int64_t RenderModelBatch::getBytesSaved( int slot ) const
+{
+	const Model & model = mModels[slot];
+	return model.textureDone ? int64_t( model.data->sourceSize ) - int64_t( model.gpuSize ) : 0;
+}
+
+int64_t RenderModelBatch::getTotalBytesSaved() const
+{
+	int64_t saved = 0;
+	for( int slot = 0; slot < (int)mModels.size(); ++slot )
+		saved += getBytesSaved( slot );
+	return saved;
+}
+
+void RenderModelBatch::allocateLayers( int numLayers )
+{
+	glDeleteTextures( 1, &mTexture );
+	glGenTextures( 1, &mTexture );
+	mNumLayers = numLayers;
+
+	gl::ScopedTextureBind scopedTexture{ GL_TEXTURE_2D_ARRAY, mTexture };
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, NUM_LAYER_LEVELS - 1 );
+	for( int level = 0; level < NUM_LAYER_LEVELS; ++level ) {
+		glTexImage3D( GL_TEXTURE_2D_ARRAY, level, mCompressed ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGBA8, LAYER_SIZE >> level, LAYER_SIZE >> level, numLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+	}
+
+	// the layers of the old array are gone, upload them again from the models' data
+	for( int slot = 0; slot < (int)mModels.size(); ++slot ) {
+		if( mModels[slot].textureDone )
+			uploadLayer( slot );
+	}
+}
+
+void RenderModelBatch::uploadLayer( int slot )
+{
+	Model & model = mModels[slot];
+	const RenderModelData & data = *model.data;
+
+	// the first model level that fits the layer becomes layer level 0
+	uint32_t first = 0;
+	while( first + 1 < data.textureLevelCount && ( ( data.textureWidth >> first ) > LAYER_SIZE || ( data.textureHeight >> first ) > LAYER_SIZE ) )
+		++first;
+	model.uvScale = vec2( std::max( 1, data.textureWidth >> first ), std::max( 1, data.textureHeight >> first ) ) / float( LAYER_SIZE );
+
+	std::vector<const uint8_t *> levels( data.textureLevelCount );
+	const uint8_t * level = data.textureLevels;
+	for( uint32_t l = 0; l < data.textureLevelCount; ++l ) {
+		levels[l] = level;
+		level += MipLevelSize( data.textureWidth, data.textureHeight, l );
+	}
+
+	// layer levels past the end of a smaller model's chain repeat its last, 1x1 level
+	gl::ScopedTextureBind scopedTexture{ GL_TEXTURE_2D_ARRAY, mTexture };
+	for( int layerLevel = 0; layerLevel < NUM_LAYER_LEVELS; ++layerLevel ) {
+		uint32_t l = std::min( first + layerLevel, data.textureLevelCount - 1 );
+		int levelWidth = std::max( 1, data.textureWidth >> l );
+		int levelHeight = std::max( 1, data.textureHeight >> l );
+		int width = std::min( levelWidth, LAYER_SIZE >> layerLevel );
+		int height = std::min( levelHeight, LAYER_SIZE >> layerLevel );
+		const uint8_t * pixels = levels[l];
+		if( mCompressed && ( width % 4 || height % 4 ) ) {
+			// compressed updates cover whole blocks, so edge pixels are repeated up to the block or level size
+			int paddedWidth = std::min( ( width + 3 ) & ~3, LAYER_SIZE >> layerLevel );
+			int paddedHeight = std::min( ( height + 3 ) & ~3, LAYER_SIZE >> layerLevel );
+			mPaddedLevel.resize( paddedWidth * paddedHeight * 4 );
+			for( int y = 0; y < paddedHeight; ++y ) {
+				for( int x = 0; x < paddedWidth; ++x ) {
+					memcpy( &mPaddedLevel[( y * paddedWidth + x ) * 4], pixels + ( std::min( y, height - 1 ) * levelWidth + std::min( x, width - 1 ) ) * 4, 4 );
+				}
+			}
+			width = paddedWidth;
+			height = paddedHeight;
+			pixels = mPaddedLevel.data();
+		}
+		glTexSubImage3D( GL_TEXTURE_2D_ARRAY, layerLevel, 0, 0, slot, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+	}
+}
+
+void RenderModelBatch::clear()
+{
+	mInstances.clear();
+	mInstancesUploaded = false;
+}
+
+void RenderModelBatch::addInstance( int slot, const mat4 & transform )
+{
+	mInstances.emplace_back( slot, transform );
+	mInstancesUploaded = false;
+}
+
+RenderModelBatch::Instance RenderModelBatch::makeInstance( int slot, const mat4 & transform ) const
+{
+	Instance instance = { transform, vec4( mModels[slot].uvScale, float( slot ), 0.0f ) };
+	return instance;
+}
+
+void RenderModelBatch::uploadInstances()
+{
+	// instances of the same model are drawn by one command; their order within it does not matter, and unlike
+	// std::stable_sort, std::sort never allocates a temporary buffer
+	std::sort( mInstances.begin(), mInstances.end(), []( const std::pair<int, mat4> & a, const std::pair<int, mat4> & b ) {
+		return a.first < b.first;
+	} );
+
+	mInstanceData.clear();
+	mCommands.clear();
+	for( const auto & instance : mInstances ) {
+		int slot = instance.first;
+		const Model & model = mModels[slot];
+		if( mCommands.empty() || mCommands.back().firstIndex != model.firstIndex ) {
+			DrawCommand command = { model.data->indexCount, 0, model.firstIndex, model.baseVertex, (GLuint)mInstanceData.size() };
+			mCommands.push_back( command );
+		}
+		++mCommands.back().instanceCount;
+		mInstanceData.push_back( makeInstance( slot, instance.second ) );
+	}
+
+	mInstanceVbo->bufferData( mInstanceData.size() * sizeof( Instance ), mInstanceData.data(), GL_STREAM_DRAW );
+	if( mMultiDrawIndirect ) {
+		mIndirectVbo->bufferData( mCommands.size() * sizeof( DrawCommand ), mCommands.data(), GL_STREAM_DRAW );
+	}
+	mInstancesUploaded = true;
+}
+
+void RenderModelBatch::draw()
+{
+	if( mInstances.empty() )
+		return;
+	if( ! mInstancesUploaded )
+		uploadInstances();
+
+	gl::ScopedVao scopedVao{ mVao };
+	gl::ScopedGlslProg scopedGlsl{ mGlsl };
+	gl::ScopedTextureBind scopedTexture{ GL_TEXTURE_2D_ARRAY, mTexture, 0 };
+	mGlsl->uniform( "viewProjection", gl::getProjectionMatrix() * gl::getViewMatrix() );
+
+	if( mMultiDrawIndirect ) {
+		gl::ScopedBuffer scopedIndirect{ mIndirectVbo };
+		glMultiDrawElementsIndirect( GL_TRIANGLES, GL_UNSIGNED_SHORT, nullptr, (GLsizei)mCommands.size(), 0 );
+	}
+	else {
+		// without base instances the instance attributes are pointed at each command's first instance
+		gl::ScopedBuffer scopedInstances{ mInstanceVbo };
+		for( const auto & command : mCommands ) {
+			pointInstanceAttribs( command.baseInstance * sizeof( Instance ) );
+			glDrawElementsInstancedBaseVertex( GL_TRIANGLES, command.count, GL_UNSIGNED_SHORT, (const void *)( command.firstIndex * sizeof( uint16_t ) ), command.instanceCount, command.baseVertex );
+		}
+		pointInstanceAttribs( 0 );
+	}
+}
+
+void RenderModelBatch::drawSingle( int slot )
+{
+	if( ! isReady( slot ) )
+		return;
+
+	Instance instance = makeInstance( slot, gl::getModelMatrix() );
+	mSingleInstanceVbo->bufferSubData( 0, sizeof( Instance ), &instance );
+
+	gl::ScopedVao scopedVao{ mSingleVao };
+	gl::ScopedGlslProg scopedGlsl{ mGlsl };
+	gl::ScopedTextureBind scopedTexture{ GL_TEXTURE_2D_ARRAY, mTexture, 0 };
+	mGlsl->uniform( "viewProjection", gl::getProjectionMatrix() * gl::getViewMatrix() );
+	const Model & model = mModels[slot];
+	glDrawElementsInstancedBaseVertex( GL_TRIANGLES, model.data->indexCount, GL_UNSIGNED_SHORT, (const void *)( model.firstIndex * sizeof( uint16_t ) ), 1, model.baseVertex );
+}
+
+RenderModelRef RenderModel::create( const std::string & name, const vr::RenderModel_t & vrModel, const vr::RenderModel_TextureMap_t & texture, RenderModelBatch * batch )
+{
+	auto blob = std::make_shared<std::vector<uint8_t>>( BuildRenderModelCacheBlob( vrModel, texture, 0 ) );
+	auto data = ViewRenderModelCacheBlob( blob->data(), blob->size(), 0 );
+	data->storage = blob;
+	data->name = name;
+
+	RenderModelRef model{ new RenderModel{ name, batch } };
+	model->uploadGeometry( data );
+	model->uploadTexture();
+	return model;
+}
+
+RenderModel::RenderModel( const std::string & sRenderModelName, RenderModelBatch * batch )
+	: mBatch( batch )
+	, mSlot( -1 )
+	, mModelName( sRenderModelName )
+{
+}
+
+void RenderModel::uploadGeometry( const RenderModelDataRef & data )
+{
+	mSlot = mBatch->addGeometry( data );
+}
+
+void RenderModel::uploadTexture()
+{
+	mBatch->addTexture( mSlot );
+}
+
+void RenderModel::draw()
+{
+	mBatch->drawSingle( mSlot );
+}
+
+RenderModelLoader::RenderModelLoader( vr::IVRRenderModels * renderModels, RenderModelBatch * batch, const fs::path & cacheDirectory, const std::string & runtimeKey )
+	: mRenderModels( renderModels )
+	, mBatch( batch )
+	, mCacheDirectory( cacheDirectory )
+	, mRuntimeHash( HashString( runtimeKey ) )
+	, mQuit( false )
+{
+	if( ! mCacheDirectory.empty() ) {
+		try {
+			fs::create_directories( mCacheDirectory );
+		}
+		catch( const std::exception & exc ) {
+			CI_LOG_W( "Render model cache disabled, unable to create " << mCacheDirectory.string() << ": " << exc.what() );
+			mCacheDirectory.clear();
+		}
+	}
+
+	mThread = std::thread( &RenderModelLoader::loadThreadFn, this );
+}
+
+RenderModelLoader::~RenderModelLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mQuit = true;
+	}
+	mCondition.notify_all();
+	mThread.join();
+}
+
+RenderModelRef RenderModelLoader::request( const std::string & name )
+{
+	auto it = mCache.find( name );
+	if( it != mCache.end() )
+		return it->second;
+
+	auto model = RenderModel::create( name, mBatch );
+	mCache.emplace( name, model );
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mLoadQueue.push_back( name );
+	}
+	mCondition.notify_one();
+	return model;
+}
+
+void RenderModelLoader::update( double budgetMs )
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		for( const auto & loaded : mLoaded ) {
+			auto it = mCache.find( loaded.first );
+			if( it == mCache.end() )
+				continue;
+
+			if( loaded.second ) {
+				Upload upload = { it->second, loaded.second, false };
+				mUploads.push_back( upload );
+			}
+			else {
+				// forget failed loads so that a reconnecting device retries
+				mCache.erase( it );
+			}
+		}
+		mLoaded.clear();
+	}
+
+	// always make progress by at least one step, then continue while the budget allows
+	Timer timer( true );
+	while( ! mUploads.empty() ) {
+		Upload & upload = mUploads.front();
+		if( ! upload.geometryDone ) {
+			upload.model->uploadGeometry( upload.data );
+			upload.geometryDone = true;
+		}
+		else {
+			upload.model->uploadTexture();
+			mUploads.pop_front();
+		}
+
+		if( timer.getSeconds() * 1000.0 >= budgetMs )
+			break;
+	}
+}
+
+size_t RenderModelLoader::getNumPending() const
+{
+	return std::count_if( mCache.begin(), mCache.end(), []( const std::pair<const std::string, RenderModelRef> & entry ) {
+		return ! entry.second->isReady();
+	} );
+}
+
+void RenderModelLoader::loadThreadFn()
+{
+	while( true ) {
+		std::string name;
+		{
+			std::unique_lock<std::mutex> lock( mMutex );
+			mCondition.wait( lock, [this] { return mQuit || ! mLoadQueue.empty(); } );
+			if( mQuit )
+				return;
+
+			name = mLoadQueue.front();
+			mLoadQueue.pop_front();
+		}
+
+		auto data = load( name );
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mLoaded.emplace_back( name, data );
+		}
+	}
+}
+
+fs::path RenderModelLoader::getCachePath( const std::string & name ) const
+{
+	if( mCacheDirectory.empty() )
+		return fs::path();
+
+	return mCacheDirectory / ( SanitizeFileName( name ) + ".cvrm" );
+}
+
+RenderModelDataRef RenderModelLoader::load( const std::string & name )
+{
+	fs::path cachePath = getCachePath( name );
+	if( ! cachePath.empty() ) {
+		auto data = MapRenderModelCache( cachePath, mRuntimeHash );
+		if( data ) {
+			data->name = name;
+			return data;
+		}
+	}
+
+	vr::RenderModel_t *pModel = NULL;
+	if( !mRenderModels->LoadRenderModel( name.c_str(), &pModel ) || pModel == NULL ) {
+		CI_LOG_E( "Unable to load render model " << name );
+		return nullptr;
+	}
+
+	vr::RenderModel_TextureMap_t *pTexture = NULL;
+	if( !mRenderModels->LoadTexture( pModel->diffuseTextureId, &pTexture ) || pTexture == NULL ) {
+		CI_LOG_E( "Unable to load render texture id " << pModel->diffuseTextureId << " for render model " << name );
+		mRenderModels->FreeRenderModel( pModel );
+		return nullptr;
+	}
+
+	auto blob = std::make_shared<std::vector<uint8_t>>( BuildRenderModelCacheBlob( *pModel, *pTexture, mRuntimeHash ) );
+	mRenderModels->FreeRenderModel( pModel );
+	mRenderModels->FreeTexture( pTexture );
+
+	// prefer the freshly written file so that the in-memory blob can be released right away
+	RenderModelDataRef data;
+	if( ! cachePath.empty() && WriteCacheFile( cachePath, *blob ) )
+		data = MapRenderModelCache( cachePath, mRuntimeHash );
+	if( ! data ) {
+		data = ViewRenderModelCacheBlob( blob->data(), blob->size(), mRuntimeHash );
+		data->storage = blob;
+	}
+	data->name = name;
+	return data;
+}
+
+StereoCuller::StereoCuller()
+	: mMargin( 0.0f )
+	, mNumTested( 0 )
+	, mNumVisible( 0 )
+{
+	for( auto & planes : mEyePlanes )
+		planes.fill( vec4( 0, 0, 0, 1 ) );
+}
+
+void StereoCuller::update( const mat4 & leftViewProjection, const mat4 & rightViewProjection )
+{
+	const mat4 * viewProjections[2] = { &leftViewProjection, &rightViewProjection };
+	vec3 corners[16];
+	for( int eye = 0; eye < 2; ++eye ) {
+		// Gribb and Hartmann: each plane is the last row of the matrix plus or minus one of the others
+		const mat4 & m = *viewProjections[eye];
+		vec4 rows[4];
+		for( int r = 0; r < 4; ++r )
+			rows[r] = vec4( m[0][r], m[1][r], m[2][r], m[3][r] );
+		for( int p = 0; p < 6; ++p ) {
+			vec4 plane = p % 2 ? rows[3] - rows[p / 2] : rows[3] + rows[p / 2];
+			mEyePlanes[eye][p] = plane / glm::length( vec3( plane ) );
+		}
+
+		mat4 inverse = glm::inverse( m );
+		for( int c = 0; c < 8; ++c ) {
+			vec4 corner = inverse * vec4( c & 1 ? 1.0f : -1.0f, c & 2 ? 1.0f : -1.0f, c & 4 ? 1.0f : -1.0f, 1.0f );
+			corners[eye * 8 + c] = vec3( corner ) / corner.w;
+		}
+	}
+
+	// keep the planes that have all corners of both frusta inside, dropping the ones both eyes share
+	float tolerance = 0.0f;
+	for( const auto & corner : corners )
+		tolerance = std::max( tolerance, glm::length( corner ) );
+	tolerance *= 1e-4f;
+
+	mPlanes.clear();
+	for( const auto & eyePlanes : mEyePlanes ) {
+		for( const auto & plane : eyePlanes ) {
+			bool bounds = true;
+			for( const auto & corner : corners )
+				bounds = bounds && glm::dot( vec3( plane ), corner ) + plane.w >= -tolerance;
+			for( const auto & kept : mPlanes )
+				bounds = bounds && ! ( glm::dot( vec3( kept ), vec3( plane ) ) > 0.9999f && std::abs( kept.w - plane.w - mMargin ) < tolerance );
+			if( bounds )
+				mPlanes.push_back( vec4( vec3( plane ), plane.w + mMargin ) );
+		}
+	}
+
+	mPlaneGroups.resize( ( mPlanes.size() + 3 ) / 4 );
+	for( size_t g = 0; g < mPlaneGroups.size(); ++g ) {
+		PlaneGroup & group = mPlaneGroups[g];
+		for( size_t i = 0; i < 4; ++i ) {
+			// padding planes have everything inside
+			vec4 plane = 4 * g + i < mPlanes.size() ? mPlanes[4 * g + i] : vec4( 0, 0, 0, 1 );
+			group.nx[i] = plane.x;
+			group.ny[i] = plane.y;
+			group.nz[i] = plane.z;
+			group.d[i] = plane.w;
+			group.ax[i] = std::abs( plane.x );
+			group.ay[i] = std::abs( plane.y );
+			group.az[i] = std::abs( plane.z );
+		}
+	}
+
+	for( auto & result : mResults )
+		result.valid = false;
+	mNumTested = 0;
+	mNumVisible = 0;
+}
+
+bool StereoCuller::isVisible( const Sphere & sphere ) const
+{
+	uint8_t visible;
+	return testSpheres( &sphere, 1, &visible ) > 0;
+}
+
+bool StereoCuller::isVisible( const AxisAlignedBox & box ) const
+{
+	uint8_t visible;
+	return testBoxes( &box, 1, &visible ) > 0;
+}
+
+size_t StereoCuller::testSpheres( const Sphere * spheres, size_t count, uint8_t * visible ) const
+{
+	size_t numVisible = 0;
+	for( size_t i = 0; i < count; ++i ) {
+		const vec3 & center = spheres[i].getCenter();
+		bool inside = true;
+#if CINDER_VIVE_SSE
+		__m128 x = _mm_set1_ps( center.x ), y = _mm_set1_ps( center.y ), z = _mm_set1_ps( center.z );
+		__m128 negativeRadius = _mm_set1_ps( -spheres[i].getRadius() );
+		for( const auto & group : mPlaneGroups ) {
+			__m128 distance = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_load_ps( group.nx ), x ), _mm_mul_ps( _mm_load_ps( group.ny ), y ) ),
+				_mm_add_ps( _mm_mul_ps( _mm_load_ps( group.nz ), z ), _mm_load_ps( group.d ) ) );
+			if( _mm_movemask_ps( _mm_cmplt_ps( distance, negativeRadius ) ) ) {
+				inside = false;
+				break;
+			}
+		}
+#else
+		for( const auto & plane : mPlanes ) {
+			if( glm::dot( vec3( plane ), center ) + plane.w < -spheres[i].getRadius() ) {
+				inside = false;
+				break;
+			}
+		}
+#endif
+		visible[i] = inside ? 1 : 0;
+		numVisible += visible[i];
+	}
+	return numVisible;
+}
+
+size_t StereoCuller::testBoxes( const AxisAlignedBox * boxes, size_t count, uint8_t * visible ) const
+{
+	// a box is outside when its corner furthest along the plane normal is: center distance plus the extents projected on |n|
+	size_t numVisible = 0;
+	for( size_t i = 0; i < count; ++i ) {
+		vec3 center = ( boxes[i].getMin() + boxes[i].getMax() ) * 0.5f;
+		vec3 extents = ( boxes[i].getMax() - boxes[i].getMin() ) * 0.5f;
+		bool inside = true;
+#if CINDER_VIVE_SSE
+		__m128 x = _mm_set1_ps( center.x ), y = _mm_set1_ps( center.y ), z = _mm_set1_ps( center.z );
+		__m128 ex = _mm_set1_ps( extents.x ), ey = _mm_set1_ps( extents.y ), ez = _mm_set1_ps( extents.z );
+		for( const auto & group : mPlaneGroups ) {
+			__m128 distance = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_load_ps( group.nx ), x ), _mm_mul_ps( _mm_load_ps( group.ny ), y ) ),
+				_mm_add_ps( _mm_mul_ps( _mm_load_ps( group.nz ), z ), _mm_load_ps( group.d ) ) );
+			__m128 reach = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_load_ps( group.ax ), ex ), _mm_mul_ps( _mm_load_ps( group.ay ), ey ) ),
+				_mm_mul_ps( _mm_load_ps( group.az ), ez ) );
+			if( _mm_movemask_ps( _mm_cmplt_ps( _mm_add_ps( distance, reach ), _mm_setzero_ps() ) ) ) {
+				inside = false;
+				break;
+			}
+		}
+#else
+		for( const auto & plane : mPlanes ) {
+			vec3 normal( plane );
+			if( glm::dot( normal, center ) + plane.w + glm::dot( glm::abs( normal ), extents ) < 0.0f ) {
+				inside = false;
+				break;
+			}
+		}
+#endif
+		visible[i] = inside ? 1 : 0;
+		numVisible += visible[i];
+	}
+	return numVisible;
+}
+
+StereoCuller::Result & StereoCuller::findResult( const void * objects, size_t count )
+{
+	// entries are reused across frames, so a scene that culls the same arrays every frame allocates nothing once warmed up
+	Result * unused = nullptr;
+	for( auto & result : mResults ) {
+		if( result.objects == objects && result.count == count )
+			return result;
+		if( ! unused && ! result.valid )
+			unused = &result;
+	}
+	if( ! unused ) {
+		mResults.push_back( Result() );
+		unused = &mResults.back();
+	}
+	unused->objects = objects;
+	unused->count = count;
+	unused->valid = false;
+	return *unused;
+}
+
+const uint8_t * StereoCuller::cullSpheres( const Sphere * spheres, size_t count )
+{
+	Result & result = findResult( spheres, count );
+	if( ! result.valid ) {
+		result.visible.resize( count );
+		mNumVisible += testSpheres( spheres, count, result.visible.data() );
+		mNumTested += count;
+		result.valid = true;
+	}
+	return result.visible.data();
+}
+
+const uint8_t * StereoCuller::cullBoxes( const AxisAlignedBox * boxes, size_t count )
+{
+	Result & result = findResult( boxes, count );
+	if( ! result.valid ) {
+		result.visible.resize( count );
+		mNumVisible += testBoxes( boxes, count, result.visible.data() );
+		mNumTested += count;
+		result.valid = true;
+	}
+	return result.visible.data();
+}
+
+const int GpuInstanceCuller::MAX_PLANES;
+const GLuint GpuInstanceCuller::LOCAL_SIZE;
+
+GpuInstanceCuller::GpuInstanceCuller()
+	: mSupported( IsGlVersionOrExtension( 4, 3, "GL_ARB_compute_shader" ) && IsGlVersionOrExtension( 4, 3, "GL_ARB_shader_storage_buffer_object" )
+		&& IsGlVersionOrExtension( 4, 3, "GL_ARB_multi_draw_indirect" ) )
+	, mNumInstances( 0 )
+	, mInstancesPerVisible( 1 )
+	, mIndexCount( 0 )
+	, mPlanesLocation( -1 )
+	, mNumPlanesLocation( -1 )
+	, mNumInstancesLocation( -1 )
+	, mInstancesPerVisibleLocation( -1 )
+{
+	mInstances = gl::Vbo::create( GL_SHADER_STORAGE_BUFFER, 0, nullptr, GL_STATIC_DRAW );
+	mVisible = gl::Vbo::create( GL_ARRAY_BUFFER, 0, nullptr, GL_DYNAMIC_COPY );
+	mCommand = gl::Vbo::create( GL_DRAW_INDIRECT_BUFFER, sizeof( DrawCommand ), nullptr, GL_DYNAMIC_DRAW );
+
+	if( ! mSupported ) {
+		CI_LOG_W( "GPU instance culling requires GL 4.3, all instances will be drawn." );
+		return;
+	}
+
+	mGlslCull = gl::GlslProg::create( gl::GlslProg::Format().compute(
+		"#version 430 core\n"
+		"layout(local_size_x = " + toString( LOCAL_SIZE ) + ") in;\n"
+		"layout(std430, binding = 0) readonly buffer Instances { vec4 instances[]; };\n"
+		"layout(std430, binding = 1) writeonly buffer Visible { vec4 visible[]; };\n"
+		"layout(std430, binding = 2) buffer Command { uint count; uint instanceCount; uint firstIndex; int baseVertex; uint baseInstance; };\n"
+		"uniform vec4 planes[" + toString( MAX_PLANES ) + "];\n"
+		"uniform int numPlanes;\n"
+		"uniform uint numInstances;\n"
+		"uniform uint instancesPerVisible;\n"
+		"void main()\n"
+		"{\n"
+		"	uint i = gl_GlobalInvocationID.x;\n"
+		"	if( i >= numInstances )\n"
+		"		return;\n"
+		"	vec4 sphere = instances[i];\n"
+		"	for( int p = 0; p < numPlanes; ++p ) {\n"
+		"		if( dot( planes[p].xyz, sphere.xyz ) + planes[p].w < -sphere.w )\n"
+		"			return;\n"
+		"	}\n"
+		"	visible[atomicAdd( instanceCount, instancesPerVisible ) / instancesPerVisible] = sphere;\n"
+		"}\n" ) );
+	// looked up once, since cull() runs every frame and uniform( name ) builds a string per call
+	mPlanesLocation = mGlslCull->getUniformLocation( "planes" );
+	mNumPlanesLocation = mGlslCull->getUniformLocation( "numPlanes" );
+	mNumInstancesLocation = mGlslCull->getUniformLocation( "numInstances" );
+	mInstancesPerVisibleLocation = mGlslCull->getUniformLocation( "instancesPerVisible" );
+}
+
+void GpuInstanceCuller::setInstances( const std::vector<vec4> & spheres )
+{
+	mNumInstances = (GLuint)spheres.size();
+	mInstances->bufferData( spheres.size() * sizeof( vec4 ), spheres.data(), GL_STATIC_DRAW );
+	// without culling the visible list is simply every instance
+	mVisible->bufferData( spheres.size() * sizeof( vec4 ), mSupported ? nullptr : spheres.data(), GL_DYNAMIC_COPY );
+}
+
+void GpuInstanceCuller::cull( const StereoCuller & culler, GLuint instancesPerVisible )
+{
+	mInstancesPerVisible = std::max<GLuint>( instancesPerVisible, 1 );
+	if( ! mSupported )
+		return;
+
+	// the compute shader counts the survivors into instanceCount; the rest of the command is fixed
+	DrawCommand command = { mIndexCount, 0, 0, 0, 0 };
+	mCommand->bufferSubData( 0, sizeof( command ), &command );
+
+	const auto & planes = culler.getPlanes();
+	int numPlanes = std::min<int>( (int)planes.size(), MAX_PLANES );
+	gl::ScopedGlslProg scopedGlsl{ mGlslCull };
+	if( numPlanes > 0 )
+		glUniform4fv( mPlanesLocation, numPlanes, glm::value_ptr( planes[0] ) );
+	glUniform1i( mNumPlanesLocation, numPlanes );
+	glUniform1ui( mNumInstancesLocation, mNumInstances );
+	glUniform1ui( mInstancesPerVisibleLocation, mInstancesPerVisible );
+
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, mInstances->getId() );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 1, mVisible->getId() );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 2, mCommand->getId() );
+	glDispatchCompute( ( mNumInstances + LOCAL_SIZE - 1 ) / LOCAL_SIZE, 1, 1 );
+	glMemoryBarrier( GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT );
+	for( GLuint binding = 0; binding < 3; ++binding )
+		glBindBufferBase( GL_SHADER_STORAGE_BUFFER, binding, 0 );
+}
+
+void GpuInstanceCuller::draw( const gl::BatchRef & batch )
+{
+	if( ! mSupported ) {
+		batch->drawInstanced( mNumInstances * mInstancesPerVisible );
+		return;
+	}
+
+	// the index count comes from the batch, so it is only known once the first frame draws
+	const auto & mesh = batch->getVboMesh();
+	if( mesh->getNumIndices() != mIndexCount ) {
+		mIndexCount = mesh->getNumIndices();
+		mCommand->bufferSubData( offsetof( DrawCommand, count ), sizeof( mIndexCount ), &mIndexCount );
+	}
+
+	gl::ScopedVao scopedVao{ batch->getVao() };
+	gl::ScopedGlslProg scopedGlsl{ batch->getGlslProg() };
+	gl::setDefaultShaderVars();
+	gl::ScopedBuffer scopedIndirect{ mCommand };
+	glMultiDrawElementsIndirect( mesh->getGlPrimitive(), mesh->getIndexDataType(), nullptr, 1, 0 );
+}
+
+GLuint GpuInstanceCuller::readNumVisible() const
+{
+	if( ! mSupported )
+		return mNumInstances;
+
+	DrawCommand command;
+	gl::ScopedBuffer scopedCommand{ mCommand };
+	glGetBufferSubData( GL_DRAW_INDIRECT_BUFFER, 0, sizeof( command ), &command );
+	return command.instanceCount / mInstancesPerVisible;
+}
+
+const int InstanceStream::NUM_SLICES;
+
+InstanceStream::InstanceStream( size_t instanceSize, uint32_t maxInstances )
+	: mMapped( nullptr )
+	, mInstanceSize( instanceSize )
+	, mMaxInstances( maxInstances )
+	, mNumSlices( IsGlVersionOrExtension( 4, 2, "GL_ARB_base_instance" ) ? NUM_SLICES : 1 )
+	, mSlice( 0 )
+	, mCount( 0 )
+{
+	for( auto & fence : mFences )
+		fence = nullptr;
+
+	GLsizeiptr size = mNumSlices * mMaxInstances * mInstanceSize;
+	mVbo = gl::Vbo::create( GL_ARRAY_BUFFER );
+	gl::ScopedBuffer scopedBuffer{ mVbo };
+	if( mNumSlices > 1 && IsGlVersionOrExtension( 4, 4, "GL_ARB_buffer_storage" ) ) {
+		GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage( GL_ARRAY_BUFFER, size, nullptr, mapFlags );
+		mMapped = static_cast<uint8_t *>( glMapBufferRange( GL_ARRAY_BUFFER, 0, size, mapFlags ) );
+	}
+	else {
+		glBufferData( GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW );
+		mStaging.resize( mMaxInstances * mInstanceSize );
+	}
+}
+
+InstanceStream::~InstanceStream()
+{
+	for( auto & fence : mFences ) {
+		if( fence )
+			glDeleteSync( fence );
+	}
+	if( mMapped ) {
+		gl::ScopedBuffer scopedBuffer{ mVbo };
+		glUnmapBuffer( GL_ARRAY_BUFFER );
+	}
+}
+
+void * InstanceStream::beginFrame()
+{
+	mSlice = ( mSlice + 1 ) % mNumSlices;
+	mCount = 0;
+	GLsync & fence = mFences[mSlice];
+	if( fence ) {
+		// with three slices this only blocks when the GPU falls more than two frames behind
+		glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000 );
+		glDeleteSync( fence );
+		fence = nullptr;
+	}
+	return mMapped ? mMapped + mSlice * mMaxInstances * mInstanceSize : mStaging.data();
+}
+
+void InstanceStream::commit( uint32_t count )
+{
+	mCount = std::min( count, mMaxInstances );
+	if( mMapped )
+		return;
+
+	gl::ScopedBuffer scopedBuffer{ mVbo };
+	if( mNumSlices == 1 ) {
+		// orphan the storage the previous frame's draws still read from
+		glBufferData( GL_ARRAY_BUFFER, mMaxInstances * mInstanceSize, nullptr, GL_STREAM_DRAW );
+	}
+	glBufferSubData( GL_ARRAY_BUFFER, mSlice * mMaxInstances * mInstanceSize, mCount * mInstanceSize, mStaging.data() );
+}
+
+void InstanceStream::draw( const gl::BatchRef & batch, GLuint instancesPerStreamed )
+{
+	if( mCount == 0 )
+		return;
+
+	const auto & mesh = batch->getVboMesh();
+	GLsizei instanceCount = mCount * instancesPerStreamed;
+	GLuint baseInstance = mSlice * mMaxInstances;
+
+	gl::ScopedVao scopedVao{ batch->getVao() };
+	gl::ScopedGlslProg scopedGlsl{ batch->getGlslProg() };
+	gl::setDefaultShaderVars();
+	// the base instance offsets per-instance attributes only, after the divisor, so it selects the slice
+	if( mesh->getNumIndices() > 0 ) {
+		if( mNumSlices > 1 )
+			glDrawElementsInstancedBaseInstance( mesh->getGlPrimitive(), mesh->getNumIndices(), mesh->getIndexDataType(), nullptr, instanceCount, baseInstance );
+		else
+			glDrawElementsInstanced( mesh->getGlPrimitive(), mesh->getNumIndices(), mesh->getIndexDataType(), nullptr, instanceCount );
+	}
+	else {
+		if( mNumSlices > 1 )
+			glDrawArraysInstancedBaseInstance( mesh->getGlPrimitive(), 0, mesh->getNumVertices(), instanceCount, baseInstance );
+		else
+			glDrawArraysInstanced( mesh->getGlPrimitive(), 0, mesh->getNumVertices(), instanceCount );
+	}
+}
+
+void InstanceStream::endFrame()
+{
+	if( mFences[mSlice] )
+		glDeleteSync( mFences[mSlice] );
+	mFences[mSlice] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+Layer::Layer( const ivec2 & size, const std::function<void()> & render, int updateInterval )
+	: mRender( render )
+	, mUpdateInterval( std::max( updateInterval, 0 ) )
+	, mDirty( true )
+	, mSpace( SPACE_WORLD )
+	, mVisible( true )
+	, mDepthTested( true )
+	, mRenderCount( 0 )
+{
+	// mipmapped, as text seen from a distance would otherwise shimmer; Cinder regenerates them after each render
+	auto textureFormat = gl::Texture2d::Format().internalFormat( GL_RGBA8 ).mipmap().minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR );
+	mFbo = gl::Fbo::create( size.x, size.y, gl::Fbo::Format().colorTexture( textureFormat ) );
+}
+
+const size_t FrameProfiler::TIMING_CAPACITY;
+
+FrameProfiler::FrameProfiler()
+	: mEnabled( false )
+	, mInFrame( false )
+	, mFrameIndex( 0 )
+	, mClock( true )
+	, mCurrent( nullptr )
+{
+	memset( mQuerySets, 0, sizeof( mQuerySets ) );
+}
+
+FrameProfiler::~FrameProfiler()
+{
+	setEnabled( false );
+}
+
+void FrameProfiler::setEnabled( bool enable )
+{
+	if( enable == mEnabled )
+		return;
+
+	for( auto & set : mQuerySets ) {
+		if( enable )
+			glGenQueries( NUM_STAGES * MAX_STAGE_SPANS * 2, &set.queries[0][0][0] );
+		else
+			glDeleteQueries( NUM_STAGES * MAX_STAGE_SPANS * 2, &set.queries[0][0][0] );
+		set.pending = false;
+	}
+	mEnabled = enable;
+	mInFrame = false;
+	mCurrent = nullptr;
+}
+
+void FrameProfiler::beginFrame()
+{
+	if( ! mEnabled )
+		return;
+	if( mInFrame )
+		endFrame();
+
+	// this set was last used two frames ago, so its queries are done by now in all but pathological cases
+	QuerySet & set = mQuerySets[mFrameIndex % NUM_QUERY_SETS];
+	if( set.pending )
+		publish( set );
+
+	set.timing.frameIndex = mFrameIndex;
+	set.timing.cpuFrameMs = 0;
+	for( int stage = 0; stage < NUM_STAGES; ++stage ) {
+		set.timing.cpuMs[stage] = 0;
+		set.timing.gpuMs[stage] = -1;
+		set.numSpans[stage] = 0;
+	}
+	set.frameStart = mClock.getSeconds();
+	mCurrent = &set;
+	mInFrame = true;
+}
+
+void FrameProfiler::endFrame()
+{
+	if( ! mInFrame )
+		return;
+
+	mCurrent->timing.cpuFrameMs = ( mClock.getSeconds() - mCurrent->frameStart ) * 1000.0;
+	mCurrent->pending = true;
+	mCurrent = nullptr;
+	mInFrame = false;
+	++mFrameIndex;
+}
+
+void FrameProfiler::beginStage( Stage stage )
+{
+	if( ! mInFrame )
+		return;
+
+	QuerySet & set = *mCurrent;
+	set.stageStart[stage] = mClock.getSeconds();
+	if( set.numSpans[stage] < MAX_STAGE_SPANS )
+		glQueryCounter( set.queries[stage][set.numSpans[stage]][0], GL_TIMESTAMP );
+}
+
+void FrameProfiler::endStage( Stage stage )
+{
+	if( ! mInFrame )
+		return;
+
+	QuerySet & set = *mCurrent;
+	set.timing.cpuMs[stage] += ( mClock.getSeconds() - set.stageStart[stage] ) * 1000.0;
+	if( set.numSpans[stage] < MAX_STAGE_SPANS )
+		glQueryCounter( set.queries[stage][set.numSpans[stage]][1], GL_TIMESTAMP );
+	set.numSpans[stage]++;
+}
+
+void FrameProfiler::publish( QuerySet & set )
+{
+	for( int stage = 0; stage < NUM_STAGES; ++stage ) {
+		// stages entered more often than there are queries for are reported without GPU time
+		int numSpans = set.numSpans[stage];
+		if( numSpans == 0 || numSpans > MAX_STAGE_SPANS )
+			continue;
+
+		// queries complete in order, so the last one being available implies all of them are
+		GLint available = 0;
+		glGetQueryObjectiv( set.queries[stage][numSpans - 1][1], GL_QUERY_RESULT_AVAILABLE, &available );
+		if( ! available )
+			continue;
+
+		GLuint64 elapsed = 0;
+		for( int span = 0; span < numSpans; ++span ) {
+			GLuint64 begin, end;
+			glGetQueryObjectui64v( set.queries[stage][span][0], GL_QUERY_RESULT, &begin );
+			glGetQueryObjectui64v( set.queries[stage][span][1], GL_QUERY_RESULT, &end );
+			elapsed += end - begin;
+		}
+		set.timing.gpuMs[stage] = elapsed / 1000000.0;
+	}
+
+	mTimings.push( set.timing );
+	set.pending = false;
+}
+
+void FrameProfiler::getTimings( std::vector<FrameTiming> * result, size_t maxFrames ) const
+{
+	result->clear();
+	uint64_t writeCount = mTimings.getWriteCount();
+	uint64_t count = std::min<uint64_t>( writeCount, std::min( maxFrames, TIMING_CAPACITY ) );
+	result->reserve( (size_t)count );
+
+	FrameTiming timing;
+	for( uint64_t index = writeCount - count; index < writeCount; ++index ) {
+		if( mTimings.read( index, &timing ) )
+			result->push_back( timing );
+	}
+}
+
+FrameProfiler::Stats FrameProfiler::getStats( Stage stage, bool gpu, size_t maxFrames ) const
+{
+	std::vector<FrameTiming> timings;
+	getTimings( &timings, maxFrames );
+
+	std::vector<double> values;
+	values.reserve( timings.size() );
+	for( const auto & timing : timings ) {
+		double value = gpu ? timing.gpuMs[stage] : timing.cpuMs[stage];
+		if( value >= 0 )
+			values.push_back( value );
+	}
+
+	Stats stats = { 0, 0, 0, values.size() };
+	if( values.empty() )
+		return stats;
+
+	std::sort( values.begin(), values.end() );
+	double sum = 0;
+	for( double value : values )
+		sum += value;
+
+	stats.min = values.front();
+	stats.avg = sum / values.size();
+	stats.p99 = values[std::min( values.size() - 1, (size_t)std::ceil( 0.99 * values.size() ) - 1 )];
+	return stats;
+}
+
+bool FrameProfiler::writeCsv( const fs::path & path, size_t maxFrames ) const
+{
+	std::ofstream out( path.string().c_str() );
+	if( ! out )
+		return false;
+
+	out << "frame,cpu_frame_ms";
+	for( int stage = 0; stage < NUM_STAGES; ++stage )
+		out << "," << getStageName( (Stage)stage ) << "_cpu_ms," << getStageName( (Stage)stage ) << "_gpu_ms";
+	out << "\n";
+
+	std::vector<FrameTiming> timings;
+	getTimings( &timings, maxFrames );
+	for( const auto & timing : timings ) {
+		out << timing.frameIndex << "," << timing.cpuFrameMs;
+		for( int stage = 0; stage < NUM_STAGES; ++stage )
+			out << "," << timing.cpuMs[stage] << "," << timing.gpuMs[stage];
+		out << "\n";
+	}
+	return !! out;
+}
+
+const char * FrameProfiler::getStageName( Stage stage )
+{
+	switch( stage ) {
+	case STAGE_UPDATE:		return "update";
+	case STAGE_POSES:		return "poses";
+	case STAGE_SCENE_LEFT:	return "scene_left";
+	case STAGE_SCENE_RIGHT:	return "scene_right";
+	case STAGE_RESOLVE:		return "resolve";
+	case STAGE_DISTORTION:	return "distortion";
+	case STAGE_SUBMIT:		return "submit";
+	default:				return "unknown";
+	}
+}
+
+glm::mat4 DeviceMotion::predict( double targetTime ) const
+{
+	float dt = float( targetTime - time );
+	glm::quat predicted = orientation;
+	float speed = glm::length( angularVelocity );
+	if( speed > 1e-6f ) {
+		// angular velocity is in tracking space, so the delta rotation is applied on the left
+		predicted = glm::normalize( glm::angleAxis( speed * dt, angularVelocity / speed ) * orientation );
+	}
+
+	glm::mat4 result = glm::mat4_cast( predicted );
+	result[3] = glm::vec4( position + velocity * dt, 1.0f );
+	return result;
+}
+
+DeviceMotionBatch::DeviceMotionBatch()
+	: time( 0 )
+{
+	DeviceMotion identity = { glm::vec3(), glm::quat(), glm::vec3(), glm::vec3(), 0, false };
+	for( uint32_t device = 0; device < SIZE; ++device )
+		set( device, identity );
+}
+
+void DeviceMotionBatch::set( uint32_t device, const DeviceMotion & motion )
+{
+	px[device] = motion.position.x;
+	py[device] = motion.position.y;
+	pz[device] = motion.position.z;
+	qx[device] = motion.orientation.x;
+	qy[device] = motion.orientation.y;
+	qz[device] = motion.orientation.z;
+	qw[device] = motion.orientation.w;
+	vx[device] = motion.velocity.x;
+	vy[device] = motion.velocity.y;
+	vz[device] = motion.velocity.z;
+	wx[device] = motion.angularVelocity.x;
+	wy[device] = motion.angularVelocity.y;
+	wz[device] = motion.angularVelocity.z;
+	valid[device] = motion.valid;
+}
+
+DeviceMotion DeviceMotionBatch::get( uint32_t device ) const
+{
+	DeviceMotion motion;
+	motion.position = glm::vec3( px[device], py[device], pz[device] );
+	motion.orientation = glm::quat( qw[device], qx[device], qy[device], qz[device] );
+	motion.velocity = glm::vec3( vx[device], vy[device], vz[device] );
+	motion.angularVelocity = glm::vec3( wx[device], wy[device], wz[device] );
+	motion.time = time;
+	motion.valid = valid[device];
+	return motion;
+}
+
+void DeviceMotionBatch::predict( double targetTime, glm::mat4 * poses ) const
+{
+	const float dt = float( targetTime - time );
+	const float halfDt = 0.5f * dt;
+
+	// rotation columns and translation of every slot; the loops below only do arithmetic on these arrays
+	alignas( 16 ) float m[12][SIZE];
+#if CINDER_VIVE_SSE
+	static_assert( SIZE % 4 == 0, "slots are predicted four at a time" );
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 vDt = _mm_set1_ps( dt );
+	const __m128 vHalfDt = _mm_set1_ps( halfDt );
+	for( int i = 0; i < SIZE; i += 4 ) {
+		// the same series as the scalar path below, four slots per instruction
+		__m128 hx = _mm_mul_ps( _mm_loadu_ps( wx + i ), vHalfDt );
+		__m128 hy = _mm_mul_ps( _mm_loadu_ps( wy + i ), vHalfDt );
+		__m128 hz = _mm_mul_ps( _mm_loadu_ps( wz + i ), vHalfDt );
+		__m128 h2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( hx, hx ), _mm_mul_ps( hy, hy ) ), _mm_mul_ps( hz, hz ) );
+		__m128 dw = _mm_sub_ps( one, _mm_mul_ps( h2, _mm_sub_ps( _mm_set1_ps( 1.0f / 2.0f ), _mm_mul_ps( h2, _mm_sub_ps( _mm_set1_ps( 1.0f / 24.0f ), _mm_mul_ps( h2, _mm_set1_ps( 1.0f / 720.0f ) ) ) ) ) ) );
+		__m128 sinc = _mm_sub_ps( one, _mm_mul_ps( h2, _mm_sub_ps( _mm_set1_ps( 1.0f / 6.0f ), _mm_mul_ps( h2, _mm_sub_ps( _mm_set1_ps( 1.0f / 120.0f ), _mm_mul_ps( h2, _mm_set1_ps( 1.0f / 5040.0f ) ) ) ) ) ) );
+		__m128 dx = _mm_mul_ps( sinc, hx ), dy = _mm_mul_ps( sinc, hy ), dz = _mm_mul_ps( sinc, hz );
+
+		__m128 ox = _mm_loadu_ps( qx + i ), oy = _mm_loadu_ps( qy + i ), oz = _mm_loadu_ps( qz + i ), ow = _mm_loadu_ps( qw + i );
+		__m128 x = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( dw, ox ), _mm_mul_ps( dx, ow ) ), _mm_mul_ps( dy, oz ) ), _mm_mul_ps( dz, oy ) );
+		__m128 y = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( dw, oy ), _mm_mul_ps( dy, ow ) ), _mm_mul_ps( dz, ox ) ), _mm_mul_ps( dx, oz ) );
+		__m128 z = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( dw, oz ), _mm_mul_ps( dz, ow ) ), _mm_mul_ps( dx, oy ) ), _mm_mul_ps( dy, ox ) );
+		__m128 w = _mm_sub_ps( _mm_sub_ps( _mm_sub_ps( _mm_mul_ps( dw, ow ), _mm_mul_ps( dx, ox ) ), _mm_mul_ps( dy, oy ) ), _mm_mul_ps( dz, oz ) );
+
+		__m128 xx = _mm_mul_ps( x, x ), yy = _mm_mul_ps( y, y ), zz = _mm_mul_ps( z, z ), ww = _mm_mul_ps( w, w );
+		__m128 xy = _mm_mul_ps( x, y ), xz = _mm_mul_ps( x, z ), yz = _mm_mul_ps( y, z );
+		__m128 xw = _mm_mul_ps( x, w ), yw = _mm_mul_ps( y, w ), zw = _mm_mul_ps( z, w );
+		__m128 s = _mm_div_ps( _mm_set1_ps( 2.0f ), _mm_add_ps( _mm_add_ps( xx, yy ), _mm_add_ps( zz, ww ) ) );
+		_mm_store_ps( m[0] + i, _mm_sub_ps( one, _mm_mul_ps( s, _mm_add_ps( yy, zz ) ) ) );
+		_mm_store_ps( m[1] + i, _mm_mul_ps( s, _mm_add_ps( xy, zw ) ) );
+		_mm_store_ps( m[2] + i, _mm_mul_ps( s, _mm_sub_ps( xz, yw ) ) );
+		_mm_store_ps( m[3] + i, _mm_mul_ps( s, _mm_sub_ps( xy, zw ) ) );
+		_mm_store_ps( m[4] + i, _mm_sub_ps( one, _mm_mul_ps( s, _mm_add_ps( xx, zz ) ) ) );
+		_mm_store_ps( m[5] + i, _mm_mul_ps( s, _mm_add_ps( yz, xw ) ) );
+		_mm_store_ps( m[6] + i, _mm_mul_ps( s, _mm_add_ps( xz, yw ) ) );
+		_mm_store_ps( m[7] + i, _mm_mul_ps( s, _mm_sub_ps( yz, xw ) ) );
+		_mm_store_ps( m[8] + i, _mm_sub_ps( one, _mm_mul_ps( s, _mm_add_ps( xx, yy ) ) ) );
+		_mm_store_ps( m[9] + i, _mm_add_ps( _mm_loadu_ps( px + i ), _mm_mul_ps( _mm_loadu_ps( vx + i ), vDt ) ) );
+		_mm_store_ps( m[10] + i, _mm_add_ps( _mm_loadu_ps( py + i ), _mm_mul_ps( _mm_loadu_ps( vy + i ), vDt ) ) );
+		_mm_store_ps( m[11] + i, _mm_add_ps( _mm_loadu_ps( pz + i ), _mm_mul_ps( _mm_loadu_ps( vz + i ), vDt ) ) );
+	}
+#else
+	for( int i = 0; i < SIZE; ++i ) {
+		// delta rotation exp( w * dt / 2 ) as truncated series in the squared half angle, so no sqrt, sin or cos
+		float hx = wx[i] * halfDt, hy = wy[i] * halfDt, hz = wz[i] * halfDt;
+		float h2 = hx * hx + hy * hy + hz * hz;
+		float dw = 1.0f - h2 * ( 1.0f / 2.0f - h2 * ( 1.0f / 24.0f - h2 * ( 1.0f / 720.0f ) ) );
+		float sinc = 1.0f - h2 * ( 1.0f / 6.0f - h2 * ( 1.0f / 120.0f - h2 * ( 1.0f / 5040.0f ) ) );
+		float dx = sinc * hx, dy = sinc * hy, dz = sinc * hz;
+
+		// delta * orientation
+		float x = dw * qx[i] + dx * qw[i] + dy * qz[i] - dz * qy[i];
+		float y = dw * qy[i] + dy * qw[i] + dz * qx[i] - dx * qz[i];
+		float z = dw * qz[i] + dz * qw[i] + dx * qy[i] - dy * qx[i];
+		float w = dw * qw[i] - dx * qx[i] - dy * qy[i] - dz * qz[i];
+
+		// scaling by 2 / |q|^2 normalizes the quaternion without a square root
+		float s = 2.0f / ( x * x + y * y + z * z + w * w );
+		m[0][i] = 1.0f - s * ( y * y + z * z );
+		m[1][i] = s * ( x * y + w * z );
+		m[2][i] = s * ( x * z - w * y );
+		m[3][i] = s * ( x * y - w * z );
+		m[4][i] = 1.0f - s * ( x * x + z * z );
+		m[5][i] = s * ( y * z + w * x );
+		m[6][i] = s * ( x * z + w * y );
+		m[7][i] = s * ( y * z - w * x );
+		m[8][i] = 1.0f - s * ( x * x + y * y );
+		m[9][i] = px[i] + vx[i] * dt;
+		m[10][i] = py[i] + vy[i] * dt;
+		m[11][i] = pz[i] + vz[i] * dt;
+	}
+#endif
+
+	for( int i = 0; i < SIZE; ++i ) {
+		if( ! valid[i] ) {
+			poses[i] = glm::mat4();
+			continue;
+		}
+		poses[i] = glm::mat4(
+			m[0][i], m[1][i], m[2][i], 0.0f,
+			m[3][i], m[4][i], m[5][i], 0.0f,
+			m[6][i], m[7][i], m[8][i], 0.0f,
+			m[9][i], m[10][i], m[11][i], 1.0f );
+	}
+}
+
+vr::EColorSpace GetColorSpace( GLenum colorFormat )
 {
-	uint32_t unRequiredBufferLen = pHmd->GetStringTrackedDeviceProperty( unDevice, prop, NULL, 0, peError );
-	if( unRequiredBufferLen == 0 )
-		return "";
+	switch( colorFormat ) {
+	// the compositor decodes sRGB textures when sampling, as it does for any sRGB view
+	case GL_SRGB8:
+	case GL_SRGB8_ALPHA8:
+		return vr::ColorSpace_Auto;
+	case GL_R11F_G11F_B10F:
+	case GL_RGB16F:
+	case GL_RGBA16F:
+	case GL_RGB32F:
+	case GL_RGBA32F:
+		return vr::ColorSpace_Linear;
+	default:
+		return vr::ColorSpace_Gamma;
+	}
+}
 
-	char *pchBuffer = new char[unRequiredBufferLen];
-	unRequiredBufferLen = pHmd->GetStringTrackedDeviceProperty( unDevice, prop, pchBuffer, unRequiredBufferLen, peError );
-	std::string sResult = pchBuffer;
-	delete[] pchBuffer;
-	return sResult;
+void SubmitEyeTextures( vr::IVRCompositor * compositor, GLuint leftTexture, GLuint rightTexture, const vr::VRTextureBounds_t * bounds, vr::EColorSpace colorSpace )
+{
+	vr::Texture_t leftEyeTexture = { (void*)leftTexture, vr::API_OpenGL, colorSpace };
+	vr::Texture_t rightEyeTexture = { (void*)rightTexture, vr::API_OpenGL, colorSpace };
+	compositor->Submit( vr::Eye_Left, &leftEyeTexture, &bounds[vr::Eye_Left] );
+	compositor->Submit( vr::Eye_Right, &rightEyeTexture, &bounds[vr::Eye_Right] );
+}
+
+CompositorThread::CompositorThread( vr::IVRCompositor * compositor, const gl::ContextRef & sharedContext, int numSlots )
+	: mCompositor( compositor )
+	, mContext( sharedContext )
+	, mFramePending( false )
+	, mSlotBusy( numSlots, false )
+	, mNextSlot( 0 )
+	, mQuit( false )
+{
+	mThread = std::thread( &CompositorThread::threadFn, this );
 }
 
-RenderModel::RenderModel( const std::string & sRenderModelName, const vr::RenderModel_t & vrModel, const vr::RenderModel_TextureMap_t & vrDiffuseTexture, gl::GlslProgRef shader )
-	: mModelName( sRenderModelName )
+CompositorThread::~CompositorThread()
 {
-	auto indicesVbo = ci::gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, sizeof( uint16_t ) * vrModel.unTriangleCount * 3, vrModel.rIndexData, GL_STATIC_DRAW );
-	auto layout = ci::gl::VboMesh::Layout().usage( GL_STATIC_DRAW ) //.interleave( false )
-		.attrib( ci::geom::Attrib::POSITION, 3 )
-		.attrib( ci::geom::Attrib::NORMAL, 3 )
-		.attrib( ci::geom::Attrib::TEX_COORD_0, 2 );
-	auto vboMesh = ci::gl::VboMesh::create( vrModel.unVertexCount, GL_TRIANGLES, { layout }, vrModel.unTriangleCount * 3, GL_UNSIGNED_SHORT, indicesVbo );
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mQuit = true;
+	}
+	mCondition.notify_all();
+	mThread.join();
 
-	ci::Surface8u surface{ const_cast<uint8_t *>(vrDiffuseTexture.rubTextureMapData), vrDiffuseTexture.unWidth, vrDiffuseTexture.unHeight, 4 * vrDiffuseTexture.unWidth, ci::SurfaceChannelOrder::RGBA };
-	mTexture = ci::gl::Texture2d::create( surface );
+	if( mFramePending )
+		glDeleteSync( mFrame.fence );
+}
 
-	mBatch = ci::gl::Batch::create( vboMesh, shader );
-	mBatch->getGlslProg()->uniform( "diffuse", 0 );
+int CompositorThread::acquireSlot()
+{
+	std::unique_lock<std::mutex> lock( mMutex );
+	int slot = mNextSlot;
+	mCondition.wait( lock, [this, slot] { return ! mSlotBusy[slot]; } );
+	mNextSlot = ( mNextSlot + 1 ) % (int)mSlotBusy.size();
+	return slot;
 }
 
-void RenderModel::draw()
+void CompositorThread::submit( const Frame & frame )
+{
+	{
+		std::unique_lock<std::mutex> lock( mMutex );
+		mCondition.wait( lock, [this] { return ! mFramePending; } );
+		mFrame = frame;
+		mFramePending = true;
+		mSlotBusy[frame.slot] = true;
+	}
+	mCondition.notify_all();
+}
+
+void CompositorThread::threadFn()
+{
+	ThreadSetup threadSetup;
+	mContext->makeCurrent();
+
+	std::array<vr::TrackedDevicePose_t, vr::k_unMaxTrackedDeviceCount> poses;
+	while( true ) {
+		Frame frame;
+		{
+			std::unique_lock<std::mutex> lock( mMutex );
+			mCondition.wait( lock, [this] { return mQuit || mFramePending; } );
+			if( mQuit )
+				return;
+			frame = mFrame;
+			mFramePending = false;
+		}
+		// the render thread may start on the frame after next
+		mCondition.notify_all();
+
+		// the render thread flushed after creating the fence, so waiting without the flush bit cannot deadlock
+		bool quit = false;
+		while( ! quit && glClientWaitSync( frame.fence, 0, 1000000 ) == GL_TIMEOUT_EXPIRED ) {
+			std::lock_guard<std::mutex> lock( mMutex );
+			quit = mQuit;
+		}
+		glDeleteSync( frame.fence );
+		// the textures may still be rendering, and must not reach the compositor
+		if( quit )
+			return;
+
+		// throttles to the display like WaitGetPoses on the render thread would; the render thread predicts its own
+		// poses, so these are only needed to open the frame. Waiting only once a frame is ready keeps every
+		// WaitGetPoses paired with a Submit and lets shutdown return without waiting out another vsync.
+		mCompositor->WaitGetPoses( poses.data(), vr::k_unMaxTrackedDeviceCount, NULL, 0 );
+		SubmitEyeTextures( mCompositor, frame.leftTexture, frame.rightTexture, frame.bounds, frame.colorSpace );
+		glFlush();
+
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mSlotBusy[frame.slot] = false;
+		}
+		mCondition.notify_all();
+	}
+}
+
+const size_t PoseHistory::CAPACITY;
+
+const int ResolutionScaler::NUM_QUERY_SETS;
+const int ResolutionScaler::GROW_DELAY_FRAMES;
+
+ResolutionScaler::ResolutionScaler()
+	: mEnabled( false )
+	, mBudgetMs( 10.0 )
+	, mMinScale( 0.5f )
+	, mMaxScale( 1.0f )
+	, mScale( 1.0f )
+	, mGpuMs( -1.0 )
+	, mFramesUnderBudget( 0 )
+	, mSettleFrames( 0 )
+	, mQuerySet( 0 )
+{
+	for( auto & pending : mPending )
+		pending = false;
+}
+
+ResolutionScaler::~ResolutionScaler()
+{
+	setEnabled( false );
+}
+
+void ResolutionScaler::setEnabled( bool enable )
+{
+	if( enable == mEnabled )
+		return;
+
+	if( enable ) {
+		glGenQueries( NUM_QUERY_SETS * 2, &mQueries[0][0] );
+	}
+	else {
+		glDeleteQueries( NUM_QUERY_SETS * 2, &mQueries[0][0] );
+		mScale = mMaxScale;
+		mGpuMs = -1.0;
+	}
+	for( auto & pending : mPending )
+		pending = false;
+	mFramesUnderBudget = 0;
+	mSettleFrames = 0;
+	mEnabled = enable;
+}
+
+void ResolutionScaler::setScaleRange( float minScale, float maxScale )
+{
+	mMinScale = glm::clamp( minScale, 0.1f, 1.0f );
+	mMaxScale = glm::clamp( maxScale, mMinScale, 1.0f );
+	mScale = glm::clamp( mScale, mMinScale, mMaxScale );
+}
+
+void ResolutionScaler::beginFrame()
+{
+	if( ! mEnabled )
+		return;
+
+	GLuint * queries = mQueries[mQuerySet];
+	if( mPending[mQuerySet] ) {
+		// issued NUM_QUERY_SETS frames ago; a frame whose result is still not there is skipped rather than waited for
+		GLint available = 0;
+		glGetQueryObjectiv( queries[1], GL_QUERY_RESULT_AVAILABLE, &available );
+		if( available ) {
+			GLuint64 start = 0, end = 0;
+			glGetQueryObjectui64v( queries[0], GL_QUERY_RESULT, &start );
+			glGetQueryObjectui64v( queries[1], GL_QUERY_RESULT, &end );
+			adapt( ( end - start ) / 1000000.0 );
+		}
+		mPending[mQuerySet] = false;
+	}
+	glQueryCounter( queries[0], GL_TIMESTAMP );
+}
+
+void ResolutionScaler::endFrame()
+{
+	if( ! mEnabled )
+		return;
+
+	glQueryCounter( mQueries[mQuerySet][1], GL_TIMESTAMP );
+	mPending[mQuerySet] = true;
+	mQuerySet = ( mQuerySet + 1 ) % NUM_QUERY_SETS;
+}
+
+void ResolutionScaler::adapt( double gpuMs )
+{
+	if( mSettleFrames > 0 ) {
+		--mSettleFrames;
+		return;
+	}
+	mGpuMs = mGpuMs < 0 ? gpuMs : mGpuMs + ( gpuMs - mGpuMs ) * 0.25;
+
+	float scale = mScale;
+	if( mGpuMs > mBudgetMs ) {
+		// fill cost follows the pixel count, i.e. the square of the scale; aim somewhat under the budget
+		scale = mScale * std::sqrt( float( 0.85 * mBudgetMs / mGpuMs ) );
+		mFramesUnderBudget = 0;
+	}
+	else if( mGpuMs < 0.7 * mBudgetMs ) {
+		// one step up from 70% of the budget stays under it down to the smallest default scale
+		if( ++mFramesUnderBudget >= GROW_DELAY_FRAMES ) {
+			scale = mScale + 0.05f;
+			mFramesUnderBudget = 0;
+		}
+	}
+	else {
+		mFramesUnderBudget = 0;
+	}
+
+	scale = glm::clamp( scale, mMinScale, mMaxScale );
+	if( scale != mScale ) {
+		mScale = scale;
+		mGpuMs = -1.0;
+		mSettleFrames = NUM_QUERY_SETS;
+	}
+}
+
+bool PoseHistory::getLatest( DeviceMotionBatch * result ) const
+{
+	uint64_t count = mSnapshots.getWriteCount();
+	return count > 0 && mSnapshots.read( count - 1, result );
+}
+
+bool PoseHistory::sample( vr::TrackedDeviceIndex_t device, double time, glm::mat4 * pose ) const
+{
+	// walk back from the newest snapshot to the first one taken at or before time
+	DeviceMotionBatch newer, older;
+	bool haveNewer = false, haveOlder = false;
+	uint64_t count = mSnapshots.getWriteCount();
+	for( uint64_t index = count; index > 0 && count - index < CAPACITY; --index ) {
+		DeviceMotionBatch snapshot;
+		if( ! mSnapshots.read( index - 1, &snapshot ) )
+			break; // overwritten by the writer, and so are all older ones
+		if( snapshot.time <= time ) {
+			older = snapshot;
+			haveOlder = true;
+			break;
+		}
+		newer = snapshot;
+		haveNewer = true;
+	}
+
+	bool olderValid = haveOlder && older.valid[device];
+	bool newerValid = haveNewer && newer.valid[device];
+	if( olderValid && newerValid && newer.time > older.time ) {
+		DeviceMotion from = older.get( device );
+		DeviceMotion to = newer.get( device );
+		float t = float( ( time - older.time ) / ( newer.time - older.time ) );
+		*pose = glm::mat4_cast( glm::slerp( from.orientation, to.orientation, t ) );
+		( *pose )[3] = glm::vec4( glm::mix( from.position, to.position, t ), 1.0f );
+	}
+	else if( olderValid ) {
+		*pose = older.get( device ).predict( time );
+	}
+	else if( newerValid ) {
+		*pose = newer.get( device ).predict( time );
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+PoseUniformBuffer::PoseUniformBuffer()
+	: mBuffer( 0 )
+	, mMapped( nullptr )
+	, mStereoOffset( 0 )
+	, mSliceSize( 0 )
+	, mSlice( 0 )
+{
+	for( auto & fence : mFences )
+		fence = nullptr;
+
+	GLint alignment = 256;
+	glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment );
+	auto align = [alignment]( GLintptr offset ) { return ( offset + alignment - 1 ) / alignment * alignment; };
+	mEyeOffset[vr::Eye_Left] = 0;
+	mEyeOffset[vr::Eye_Right] = align( sizeof( EyeUniforms ) );
+	mStereoOffset = align( mEyeOffset[vr::Eye_Right] + sizeof( EyeUniforms ) );
+	mSliceSize = align( mStereoOffset + sizeof( StereoUniforms ) );
+
+	bool bufferStorage = IsGlVersionOrExtension( 4, 4, "GL_ARB_buffer_storage" );
+
+	glGenBuffers( 1, &mBuffer );
+	gl::ScopedBuffer scopedBuffer{ GL_UNIFORM_BUFFER, mBuffer };
+	if( bufferStorage ) {
+		GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage( GL_UNIFORM_BUFFER, NUM_SLICES * mSliceSize, nullptr, mapFlags | GL_DYNAMIC_STORAGE_BIT );
+		mMapped = static_cast<uint8_t *>( glMapBufferRange( GL_UNIFORM_BUFFER, 0, NUM_SLICES * mSliceSize, mapFlags ) );
+	}
+	else {
+		glBufferData( GL_UNIFORM_BUFFER, NUM_SLICES * mSliceSize, nullptr, GL_DYNAMIC_DRAW );
+	}
+}
+
+PoseUniformBuffer::~PoseUniformBuffer()
+{
+	for( auto & fence : mFences ) {
+		if( fence )
+			glDeleteSync( fence );
+	}
+	if( mMapped ) {
+		gl::ScopedBuffer scopedBuffer{ GL_UNIFORM_BUFFER, mBuffer };
+		glUnmapBuffer( GL_UNIFORM_BUFFER );
+	}
+	glDeleteBuffers( 1, &mBuffer );
+}
+
+void PoseUniformBuffer::beginFrame()
+{
+	mSlice = ( mSlice + 1 ) % NUM_SLICES;
+	GLsync & fence = mFences[mSlice];
+	if( fence ) {
+		// with three slices this only blocks when the GPU falls more than two frames behind
+		glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000 );
+		glDeleteSync( fence );
+		fence = nullptr;
+	}
+}
+
+void PoseUniformBuffer::write( const EyeUniforms & left, const EyeUniforms & right, const StereoUniforms & stereo )
+{
+	GLintptr sliceOffset = mSlice * mSliceSize;
+	if( mMapped ) {
+		memcpy( mMapped + sliceOffset + mEyeOffset[vr::Eye_Left], &left, sizeof( EyeUniforms ) );
+		memcpy( mMapped + sliceOffset + mEyeOffset[vr::Eye_Right], &right, sizeof( EyeUniforms ) );
+		memcpy( mMapped + sliceOffset + mStereoOffset, &stereo, sizeof( StereoUniforms ) );
+	}
+	else {
+		gl::ScopedBuffer scopedBuffer{ GL_UNIFORM_BUFFER, mBuffer };
+		glBufferSubData( GL_UNIFORM_BUFFER, sliceOffset + mEyeOffset[vr::Eye_Left], sizeof( EyeUniforms ), &left );
+		glBufferSubData( GL_UNIFORM_BUFFER, sliceOffset + mEyeOffset[vr::Eye_Right], sizeof( EyeUniforms ), &right );
+		glBufferSubData( GL_UNIFORM_BUFFER, sliceOffset + mStereoOffset, sizeof( StereoUniforms ), &stereo );
+	}
+}
+
+void PoseUniformBuffer::bindEye( vr::Hmd_Eye eye, GLuint binding ) const
+{
+	glBindBufferRange( GL_UNIFORM_BUFFER, binding, mBuffer, mSlice * mSliceSize + mEyeOffset[eye], sizeof( EyeUniforms ) );
+}
+
+void PoseUniformBuffer::bindStereo( GLuint binding ) const
+{
+	glBindBufferRange( GL_UNIFORM_BUFFER, binding, mBuffer, mSlice * mSliceSize + mStereoOffset, sizeof( StereoUniforms ) );
+}
+
+void PoseUniformBuffer::endFrame()
+{
+	if( mFences[mSlice] )
+		glDeleteSync( mFences[mSlice] );
+	mFences[mSlice] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+#if CINDER_VIVE_LATENCY_TRACKING
+const int LatencyTracker::NUM_BINS;
+const int LatencyTracker::SAMPLE_CAPACITY;
+
+LatencyTracker::LatencyTracker()
+	: mClock( true )
+	, mHasPoses( false )
+	, mFrameIndex( 0 )
+{
+	memset( &mCurrent, 0, sizeof( mCurrent ) );
+	reset();
+}
+
+void LatencyTracker::markPosesReady()
+{
+	mCurrent.frameIndex = mFrameIndex;
+	mCurrent.posesTime = mClock.getSeconds();
+	mCurrent.eyeTime[0] = mCurrent.eyeTime[1] = mCurrent.posesTime;
+	mHasPoses = true;
+}
+
+void LatencyTracker::markEyeConsumed( vr::Hmd_Eye eye )
+{
+	mCurrent.eyeTime[eye] = mClock.getSeconds();
+}
+
+void LatencyTracker::markSubmitted()
+{
+	// frames submitted without fresh poses (e.g. bind() was skipped) say nothing about pose age
+	if( ! mHasPoses )
+		return;
+
+	mCurrent.submitTime = mClock.getSeconds();
+	for( int eye = 0; eye < 2; ++eye )
+		mCurrent.eyeAgeMs[eye] = ( mCurrent.eyeTime[eye] - mCurrent.posesTime ) * 1000.0;
+	mCurrent.submitAgeMs = ( mCurrent.submitTime - mCurrent.posesTime ) * 1000.0;
+
+	int bin = std::min( NUM_BINS - 1, (int)( mCurrent.submitAgeMs / getBinWidthMs() ) );
+	mHistogram[bin].fetch_add( 1, std::memory_order_relaxed );
+	mSamples.push( mCurrent );
+
+	mHasPoses = false;
+	++mFrameIndex;
+}
+
+void LatencyTracker::reset()
+{
+	for( auto & bin : mHistogram )
+		bin.store( 0, std::memory_order_relaxed );
+}
+
+std::vector<uint32_t> LatencyTracker::getHistogram() const
+{
+	std::vector<uint32_t> result( NUM_BINS );
+	for( int bin = 0; bin < NUM_BINS; ++bin )
+		result[bin] = mHistogram[bin].load( std::memory_order_relaxed );
+	return result;
+}
+
+double LatencyTracker::getPercentileMs( double percentile ) const
+{
+	auto histogram = getHistogram();
+	uint64_t total = 0;
+	for( uint32_t count : histogram )
+		total += count;
+	if( total == 0 )
+		return 0;
+
+	uint64_t target = (uint64_t)std::ceil( percentile * total );
+	uint64_t accumulated = 0;
+	for( int bin = 0; bin < NUM_BINS; ++bin ) {
+		accumulated += histogram[bin];
+		if( accumulated >= target )
+			return ( bin + 1 ) * getBinWidthMs();
+	}
+	return NUM_BINS * getBinWidthMs();
+}
+
+void LatencyTracker::getSamples( std::vector<Sample> * result, size_t maxSamples ) const
 {
-	ci::gl::ScopedTextureBind tex0{ mTexture, 0 };
-	mBatch->draw();
+	result->clear();
+	uint64_t writeCount = mSamples.getWriteCount();
+	uint64_t count = std::min<uint64_t>( writeCount, std::min<size_t>( maxSamples, SAMPLE_CAPACITY ) );
+	result->reserve( (size_t)count );
+
+	Sample sample;
+	for( uint64_t index = writeCount - count; index < writeCount; ++index ) {
+		if( mSamples.read( index, &sample ) )
+			result->push_back( sample );
+	}
 }
 
+bool LatencyTracker::writeCsv( const fs::path & path ) const
+{
+	std::ofstream out( path.string().c_str() );
+	if( ! out )
+		return false;
+
+	out << "submit_pose_age_ms,frames\n";
+	auto histogram = getHistogram();
+	for( int bin = 0; bin < NUM_BINS; ++bin )
+		out << bin * getBinWidthMs() << "," << histogram[bin] << "\n";
+	return !! out;
+}
+#endif
+
+HtcVive::Options::Options()
+	: mCacheDirectory( getTemporaryDirectory() / "CinderVive" )
+	, mLensGridSize( 43, 43 )
+	, mPipelinedSubmit( false )
+	, mMsaaSamples( 4 )
+	, mColorFormat( GL_RGBA8 )
+	, mDepthFormat( GL_DEPTH24_STENCIL8 )
+	, mResolveBuffers( 1 )
+	, mSharedEyeTarget( false )
+	, mCompressRenderModelTextures( false )
+{
+}
 
-HtcVive::HtcVive()
-	: mHMD( nullptr )
+HtcVive::HtcVive( const Options & options )
+	: mOptions( options )
+	, mHMD( nullptr )
 	, m_pRenderModels( nullptr )
+	, mTrackingClock( true )
+	, mLensSampler( 0 )
 	, m_glControllerVertBuffer( 0 )
 	, m_unControllerVAO( 0 )
-	, m_unLensVAO( 0 )
+	, mMirrorRectLocation( -1 )
+	, mMirrorUvRectLocation( -1 )
+	, mMirrorMode( MIRROR_DISTORTED )
+	, mMirrorInterval( 1 )
+	, mMirrorFrame( 0 )
+	, mHiddenAreaMask( false )
+	, mHiddenAreaPixelsSaved( 0 )
+	, mFoveation( false )
+	, mFoveationRadius( 0.3f )
+	, mFoveationScale( 0.5f )
 	, m_nControllerMatrixLocation( -1 )
 	, m_iTrackedControllerCount( 0 )
 	, m_iTrackedControllerCount_Last( -1 )
 	, m_iValidPoseCount( 0 )
 	, m_iValidPoseCount_Last( -1 )
+	, mResolveBuffer( 0 )
+	, mNumResolveBuffers( 1 )
+	, mFrameIsDoubleWide( false )
+	, mLensUvScaleLocation( -1 )
+	, mLensUvOffsetLocation( -1 )
+	, mReprojection( false )
+	, mReprojectionWatchdogMs( 0.0 )
+	, mHasReprojectionHistory( false )
+	, mFrameStartTime( -1.0 )
+	, mFrameReprojected( false )
+	, mFreshFrames( 0 )
+	, mReprojectedFrames( 0 )
+	, mLayerFrame( 0 )
+	, mLayersRendered( 0 )
+	, mRenderModelUploadBudgetMs( 1.0 )
 {
 	memset( m_rDevClassChar, 0, sizeof( m_rDevClassChar ) );
+	memset( m_strPoseClasses, 0, sizeof( m_strPoseClasses ) );
 
 	m_fNearClip = 0.1f;
 	m_fFarClip = 37.0f;
@@ -81,14 +2328,31 @@ HtcVive::HtcVive()
 
 	mDriver = GetTrackedDeviceString( mHMD, vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_TrackingSystemName_String );
 	mDisplay = GetTrackedDeviceString( mHMD, vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_SerialNumber_String );
-
-
-	setupShaders();
-	setupCameras();
-	setupStereoRenderTargets();
-	setupDistortion();
-	setupRenderModels();
-	setupCompositor();
+	mDisplayFrequency = mHMD->GetFloatTrackedDeviceProperty( vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_DisplayFrequency_Float );
+	if( mDisplayFrequency <= 0 )
+		mDisplayFrequency = 90.0f;
+	mSecondsFromVsyncToPhotons = mHMD->GetFloatTrackedDeviceProperty( vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_SecondsFromVsyncToPhotons_Float );
+
+
+	// a throwing constructor never runs the destructor, so the runtime session has to be shut down here
+	try {
+		setupShaders();
+		setupCameras();
+		mPoseUniforms.reset( new PoseUniformBuffer );
+		setupStereoRenderTargets();
+		setupDistortion();
+		setupHiddenAreaMesh();
+		setupRenderModels();
+		setupCompositor();
+	}
+	catch( ... ) {
+		// the threads still using the runtime go first, as in the destructor
+		mCompositorThread.reset();
+		mRenderModelLoader.reset();
+		mHMD = nullptr;
+		vr::VR_Shutdown();
+		throw;
+	}
 }
 
 
@@ -99,27 +2363,20 @@ HtcVive::~HtcVive()
 	glDeleteBuffers( 1, &m_glIDVertBuffer );
 	glDeleteBuffers( 1, &m_glIDIndexBuffer );
 
-	glDeleteRenderbuffers( 1, &leftEyeDesc.m_nDepthBufferId );
-	glDeleteTextures( 1, &leftEyeDesc.m_nRenderTextureId );
-	glDeleteFramebuffers( 1, &leftEyeDesc.m_nRenderFramebufferId );
-	glDeleteTextures( 1, &leftEyeDesc.m_nResolveTextureId );
-	glDeleteFramebuffers( 1, &leftEyeDesc.m_nResolveFramebufferId );
-
-	glDeleteRenderbuffers( 1, &rightEyeDesc.m_nDepthBufferId );
-	glDeleteTextures( 1, &rightEyeDesc.m_nRenderTextureId );
-	glDeleteFramebuffers( 1, &rightEyeDesc.m_nRenderFramebufferId );
-	glDeleteTextures( 1, &rightEyeDesc.m_nResolveTextureId );
-	glDeleteFramebuffers( 1, &rightEyeDesc.m_nResolveFramebufferId );
+	// the compositor thread may still be submitting from the targets
+	mCompositorThread.reset();
+	mEyeTargets[vr::Eye_Left].reset();
+	mEyeTargets[vr::Eye_Right].reset();
+	mDoubleWideTarget.reset();
 
-	if( m_unLensVAO != 0 )
-	{
-		glDeleteVertexArrays( 1, &m_unLensVAO );
-	}
+	glDeleteSamplers( 1, &mLensSampler );
 	if( m_unControllerVAO != 0 )
 	{
 		glDeleteVertexArrays( 1, &m_unControllerVAO );
 	}
 
+	mRenderModelLoader.reset();
+
 	if( mHMD ) {
 		vr::VR_Shutdown();
 		mHMD = nullptr;
@@ -128,11 +2385,16 @@ HtcVive::~HtcVive()
 
 void hmd::HtcVive::update()
 {
+	mProfiler.beginFrame();
+	FrameProfiler::ScopedStage stage{ mProfiler, FrameProfiler::STAGE_UPDATE };
+
 	vr::VREvent_t event;
 	while( mHMD->PollNextEvent( &event ) ) {
 		processVREvent( event );
 	}
 
+	mRenderModelLoader->update( mRenderModelUploadBudgetMs );
+
 	// Process SteamVR controller state
 	for( vr::TrackedDeviceIndex_t unDevice = 0; unDevice < vr::k_unMaxTrackedDeviceCount; unDevice++ ) {
 		vr::VRControllerState_t state;
@@ -144,15 +2406,57 @@ void hmd::HtcVive::update()
 
 void HtcVive::bind()
 {
+	mGlState.beginFrame();
 	updateHMDMatrixPose();
+	mFrameStartTime = getTrackingTime();
+	mFrameReprojected = false;
+	gatherDeviceInstances();
+	mCuller.update( getCurrentViewProjectionMatrix( vr::Eye_Left ), getCurrentViewProjectionMatrix( vr::Eye_Right ) );
+	selectResolveBuffer( mCompositorThread ? mCompositorThread->acquireSlot() : ( mResolveBuffer + 1 ) % mNumResolveBuffers );
+
+	mResolutionScaler.beginFrame();
+	float scale = mResolutionScaler.getScale();
+	mViewportSize.x = std::max<uint32_t>( 1, uint32_t( mRenderSize.x * scale + 0.5f ) );
+	mViewportSize.y = std::max<uint32_t>( 1, uint32_t( mRenderSize.y * scale + 0.5f ) );
+
+	mPoseUniforms->beginFrame();
+	writePoseUniforms( m_mat4HMDPose, mDevicePose );
+
+	updateLayers();
 }
 
 void hmd::HtcVive::unbind()
 {
-	vr::Texture_t leftEyeTexture = { (void*)leftEyeDesc.m_nResolveTextureId, vr::API_OpenGL, vr::ColorSpace_Gamma };
-	vr::VRCompositor()->Submit( vr::Eye_Left, &leftEyeTexture );
-	vr::Texture_t rightEyeTexture = { (void*)rightEyeDesc.m_nResolveTextureId, vr::API_OpenGL, vr::ColorSpace_Gamma };
-	vr::VRCompositor()->Submit( vr::Eye_Right, &rightEyeTexture );
+	mResolutionScaler.endFrame();
+
+	mProfiler.beginStage( FrameProfiler::STAGE_SUBMIT );
+	vr::VRTextureBounds_t bounds[2];
+	getSubmitBounds( bounds );
+	GLuint leftTexture = mFrameIsDoubleWide ? mDoubleWideTarget->getResolveTexture() : mEyeTargets[vr::Eye_Left]->getResolveTexture();
+	GLuint rightTexture = mFrameIsDoubleWide ? mDoubleWideTarget->getResolveTexture() : mEyeTargets[vr::Eye_Right]->getResolveTexture();
+	vr::EColorSpace colorSpace = mFrameIsDoubleWide ? mDoubleWideTarget->getColorSpace() : mEyeTargets[vr::Eye_Left]->getColorSpace();
+	if( mFrameReprojected ) {
+		// the watchdog already covered this frame's vsync with a reprojected frame, so the late one only becomes history
+	}
+	else if( mCompositorThread ) {
+		CompositorThread::Frame frame = { mResolveBuffer, leftTexture, rightTexture, { bounds[vr::Eye_Left], bounds[vr::Eye_Right] }, colorSpace, glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 ) };
+		// the fence has to reach the GPU before the compositor thread can see it signaled
+		glFlush();
+		mCompositorThread->submit( frame );
+	}
+	else {
+		SubmitEyeTextures( vr::VRCompositor(), leftTexture, rightTexture, bounds, colorSpace );
+	}
+	if( mReprojection ) {
+		captureReprojectionHistory( leftTexture, rightTexture, bounds );
+	}
+	mProfiler.endStage( FrameProfiler::STAGE_SUBMIT );
+	if( ! mFrameReprojected ) {
+		++mFreshFrames;
+		LATENCY_MARK( markSubmitted() );
+	}
+	mFrameStartTime = -1.0;
+	mPoseUniforms->endFrame();
 
 	// Spew out the controller and pose count whenever they change.
 	if( m_iTrackedControllerCount != m_iTrackedControllerCount_Last || m_iValidPoseCount != m_iValidPoseCount_Last )
@@ -160,8 +2464,10 @@ void hmd::HtcVive::unbind()
 		m_iValidPoseCount_Last = m_iValidPoseCount;
 		m_iTrackedControllerCount_Last = m_iTrackedControllerCount;
 
-		//CI_LOG_I( "PoseCount:%d(%s) Controllers:%d\n", m_iValidPoseCount, m_strPoseClasses.c_str(), m_iTrackedControllerCount );
+		//CI_LOG_I( "PoseCount:%d(%s) Controllers:%d\n", m_iValidPoseCount, m_strPoseClasses, m_iTrackedControllerCount );
 	}
+
+	mProfiler.endFrame();
 }
 
 void hmd::HtcVive::setupShaders()
@@ -186,6 +2492,8 @@ void hmd::HtcVive::setupShaders()
 		// fragment shader
 		"#version 410 core\n"
 		"uniform sampler2D mytexture;\n"
+		"uniform vec2 uvScale = vec2( 1.0, 1.0 );\n"
+		"uniform vec2 uvOffset = vec2( 0.0, 0.0 );\n"
 
 		"noperspective  in vec2 v2UVred;\n"
 		"noperspective  in vec2 v2UVgreen;\n"
@@ -200,176 +2508,498 @@ void hmd::HtcVive::setupShaders()
 		"	{ outputColor = vec4( 0, 0, 0, 1.0 ); }\n"
 		"	else\n"
 		"	{\n"
-		"		float red = texture(mytexture, v2UVred).x;\n"
-		"		float green = texture(mytexture, v2UVgreen).y;\n"
-		"		float blue = texture(mytexture, v2UVblue).z;\n"
+		"		float red = texture(mytexture, v2UVred * uvScale + uvOffset).x;\n"
+		"		float green = texture(mytexture, v2UVgreen * uvScale + uvOffset).y;\n"
+		"		float blue = texture(mytexture, v2UVblue * uvScale + uvOffset).z;\n"
 		"		outputColor = vec4( red, green, blue, 1.0  ); }\n"
 		"}\n"
 		);
+	mLensUvScaleLocation = mGlslLens->getUniformLocation( "uvScale" );
+	mLensUvOffsetLocation = mGlslLens->getUniformLocation( "uvOffset" );
+
+	// hidden-area meshes come in texture space with the origin at the top left, and are drawn at the near plane
+	mGlslHiddenArea = ci::gl::GlslProg::create(
+		"#version 410 core\n"
+		"layout(location = 0) in vec2 position;\n"
+		"void main()\n"
+		"{\n"
+		"	gl_Position = vec4( position.x * 2.0 - 1.0, 1.0 - position.y * 2.0, -1.0, 1.0 );\n"
+		"}\n",
+
+		"#version 410 core\n"
+		"void main()\n"
+		"{\n"
+		"}\n" );
+
+	// undistorted mirror quads, generated from gl_VertexID as a 4 vertex triangle strip
+	mGlslMirror = ci::gl::GlslProg::create(
+		"#version 410 core\n"
+		"uniform vec4 rect;\n"
+		"uniform vec4 uvRect;\n"
+		"noperspective out vec2 v2UV;\n"
+		"void main()\n"
+		"{\n"
+		"	vec2 corner = vec2( gl_VertexID & 1, gl_VertexID >> 1 );\n"
+		"	v2UV = mix( uvRect.xy, uvRect.zw, corner );\n"
+		"	gl_Position = vec4( mix( rect.xy, rect.zw, corner ), 0.0, 1.0 );\n"
+		"}\n"
+		,
+		"#version 410 core\n"
+		"uniform sampler2D mytexture;\n"
+		"noperspective in vec2 v2UV;\n"
+		"out vec4 outputColor;\n"
+		"void main()\n"
+		"{\n"
+		"	outputColor = vec4( texture( mytexture, v2UV ).rgb, 1.0 );\n"
+		"}\n" );
+	mMirrorRectLocation = mGlslMirror->getUniformLocation( "rect" );
+	mMirrorUvRectLocation = mGlslMirror->getUniformLocation( "uvRect" );
 
-	mGlslModel = ci::gl::GlslProg::create(
-		"#version 410\n"
-		"uniform mat4	ciModelViewProjection;\n"
-		"in vec4		ciPosition;\n"
-		"in vec3		ciNormal;\n"
-		"in vec2		ciTexCoord0;\n"
-		"out vec2		vTexCoord;\n"
+	// rotational reprojection: each pixel's direction is unprojected onto the far plane, rotated into the old eye and projected there
+	mGlslReproject = ci::gl::GlslProg::create(
+		"#version 410 core\n"
+		"noperspective out vec2 v2Ndc;\n"
 		"void main()\n"
 		"{\n"
-		"	vTexCoord = ciTexCoord0;\n"
-		"	gl_Position = ciModelViewProjection * vec4(ciPosition.xyz, 1);\n"
+		"	v2Ndc = vec2( gl_VertexID & 1, gl_VertexID >> 1 ) * 2.0 - 1.0;\n"
+		"	gl_Position = vec4( v2Ndc, 0.0, 1.0 );\n"
 		"}\n"
 		,
-		"#version 410\n"
-		"uniform sampler2D	diffuse;\n"
-		"in vec2			vTexCoord;\n"
-		"out vec4			outputColor;\n"
+		"#version 410 core\n"
+		"uniform sampler2D history;\n"
+		"uniform mat4 unproject;\n"
+		"uniform mat4 reproject;\n"
+		"noperspective in vec2 v2Ndc;\n"
+		"out vec4 outputColor;\n"
 		"void main()\n"
 		"{\n"
-		"   outputColor = texture( diffuse, vTexCoord );\n"
+		"	vec4 far = unproject * vec4( v2Ndc, 1.0, 1.0 );\n"
+		"	vec4 clip = reproject * vec4( far.xyz / far.w, 1.0 );\n"
+		"	vec2 uv = clip.xy / clip.w * 0.5 + 0.5;\n"
+		"	bool inside = clip.w > 0.0 && all( greaterThanEqual( uv, vec2( 0.0 ) ) ) && all( lessThanEqual( uv, vec2( 1.0 ) ) );\n"
+		"	outputColor = inside ? vec4( texture( history, uv ).rgb, 1.0 ) : vec4( 0.0, 0.0, 0.0, 1.0 );\n"
 		"}\n" );
+	mReprojectUnprojectLocation = mGlslReproject->getUniformLocation( "unproject" );
+	mReprojectReprojectLocation = mGlslReproject->getUniformLocation( "reproject" );
+}
+
+
+const GLuint GlStateCache::NUM_SAMPLER_UNITS;
+
+GlStateCache::GlStateCache()
+	: mDirectStateAccess( IsGlVersionOrExtension( 4, 5, "GL_ARB_direct_state_access" ) )
+	, mIssued( 0 )
+	, mSkipped( 0 )
+	, mLastIssued( 0 )
+	, mLastSkipped( 0 )
+{
+	for( auto & sampler : mSamplers )
+		sampler = 0;
+}
+
+void GlStateCache::beginFrame()
+{
+	mLastIssued = mIssued;
+	mLastSkipped = mSkipped;
+	mIssued = 0;
+	mSkipped = 0;
+}
+
+void GlStateCache::bindFramebuffer( GLenum target, GLuint framebuffer )
+{
+	auto ctx = gl::context();
+	bool bound = target == GL_FRAMEBUFFER
+		? ctx->getFramebuffer( GL_READ_FRAMEBUFFER ) == framebuffer && ctx->getFramebuffer( GL_DRAW_FRAMEBUFFER ) == framebuffer
+		: ctx->getFramebuffer( target ) == framebuffer;
+	if( bound ) {
+		++mSkipped;
+		return;
+	}
+	ctx->bindFramebuffer( target, framebuffer );
+	++mIssued;
+}
+
+void GlStateCache::bindGlslProg( const gl::GlslProgRef & glsl )
+{
+	auto ctx = gl::context();
+	if( ctx->getGlslProg() == glsl.get() ) {
+		++mSkipped;
+		return;
+	}
+	ctx->bindGlslProg( glsl.get() );
+	++mIssued;
 }
 
+void GlStateCache::bindVao( const gl::VaoRef & vao )
+{
+	auto ctx = gl::context();
+	if( ctx->getVao() == vao.get() ) {
+		++mSkipped;
+		return;
+	}
+	ctx->bindVao( vao.get() );
+	++mIssued;
+}
+
+void GlStateCache::bindTexture( GLenum target, GLuint texture, uint8_t unit )
+{
+	auto ctx = gl::context();
+	if( ctx->getTextureBinding( target, unit ) == texture ) {
+		++mSkipped;
+		return;
+	}
+	ctx->bindTexture( target, texture, unit );
+	++mIssued;
+}
+
+void GlStateCache::bindSampler( GLuint unit, GLuint sampler )
+{
+	if( unit < NUM_SAMPLER_UNITS && mSamplers[unit] == sampler ) {
+		++mSkipped;
+		return;
+	}
+	glBindSampler( unit, sampler );
+	if( unit < NUM_SAMPLER_UNITS )
+		mSamplers[unit] = sampler;
+	++mIssued;
+}
+
+void GlStateCache::enable( GLenum cap, bool enable )
+{
+	auto ctx = gl::context();
+	if( ( ctx->getBoolState( cap ) != GL_FALSE ) == enable ) {
+		++mSkipped;
+		return;
+	}
+	ctx->setBoolState( cap, enable ? GL_TRUE : GL_FALSE );
+	++mIssued;
+}
+
+void GlStateCache::viewport( const ivec2 & position, const ivec2 & size )
+{
+	auto ctx = gl::context();
+	auto area = std::make_pair( position, size );
+	if( ctx->getViewport() == area ) {
+		++mSkipped;
+		return;
+	}
+	ctx->viewport( area );
+	++mIssued;
+}
+
+void GlStateCache::scissor( const ivec2 & position, const ivec2 & size )
+{
+	auto ctx = gl::context();
+	auto area = std::make_pair( position, size );
+	if( ctx->getScissor() == area ) {
+		++mSkipped;
+		return;
+	}
+	ctx->setScissor( area );
+	++mIssued;
+}
+
+void GlStateCache::colorMask( bool red, bool green, bool blue, bool alpha )
+{
+	glColorMask( red, green, blue, alpha );
+	++mIssued;
+}
 
-bool CreateFrameBuffer( int nWidth, int nHeight, FramebufferDesc &framebufferDesc )
+void GlStateCache::stencilFunc( GLenum func, GLint ref, GLuint mask )
 {
-	glGenFramebuffers( 1, &framebufferDesc.m_nRenderFramebufferId );
-	glBindFramebuffer( GL_FRAMEBUFFER, framebufferDesc.m_nRenderFramebufferId );
-
-	glGenRenderbuffers( 1, &framebufferDesc.m_nDepthBufferId );
-	glBindRenderbuffer( GL_RENDERBUFFER, framebufferDesc.m_nDepthBufferId );
-	glRenderbufferStorageMultisample( GL_RENDERBUFFER, 4, GL_DEPTH_COMPONENT, nWidth, nHeight );
-	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, framebufferDesc.m_nDepthBufferId );
+	glStencilFunc( func, ref, mask );
+	++mIssued;
+}
 
-	glGenTextures( 1, &framebufferDesc.m_nRenderTextureId );
-	glBindTexture( GL_TEXTURE_2D_MULTISAMPLE, framebufferDesc.m_nRenderTextureId );
-	glTexImage2DMultisample( GL_TEXTURE_2D_MULTISAMPLE, 4, GL_RGBA8, nWidth, nHeight, true );
-	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, framebufferDesc.m_nRenderTextureId, 0 );
+void GlStateCache::stencilOp( GLenum stencilFail, GLenum depthFail, GLenum depthPass )
+{
+	glStencilOp( stencilFail, depthFail, depthPass );
+	++mIssued;
+}
 
-	glGenFramebuffers( 1, &framebufferDesc.m_nResolveFramebufferId );
-	glBindFramebuffer( GL_FRAMEBUFFER, framebufferDesc.m_nResolveFramebufferId );
+void GlStateCache::clear( GLbitfield mask )
+{
+	glClear( mask );
+	++mIssued;
+}
 
-	glGenTextures( 1, &framebufferDesc.m_nResolveTextureId );
-	glBindTexture( GL_TEXTURE_2D, framebufferDesc.m_nResolveTextureId );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0 );
-	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, nWidth, nHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
-	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, framebufferDesc.m_nResolveTextureId, 0 );
+void GlStateCache::clearStencil( GLint value )
+{
+	glClearStencil( value );
+	glClear( GL_STENCIL_BUFFER_BIT );
+	glClearStencil( 0 );
+	mIssued += 3;
+}
 
-	// check FBO status
-	GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
-	if( status != GL_FRAMEBUFFER_COMPLETE )
-	{
-		return false;
+RenderTarget::RenderTarget( const ivec2 & size, int samples, GLenum colorFormat, GLenum depthFormat, int numBuffers )
+	: mSize( size )
+	, mSamples( samples )
+	, mHasStencil( depthFormat == GL_DEPTH24_STENCIL8 || depthFormat == GL_DEPTH32F_STENCIL8 || depthFormat == GL_STENCIL_INDEX8 )
+	, mColorSpace( GetColorSpace( colorFormat ) )
+	, mCanInvalidate( IsGlVersionOrExtension( 4, 3, "GL_ARB_invalidate_subdata" ) )
+	, mRenderFramebuffer( 0 )
+	, mColorBuffer( 0 )
+	, mDepthBuffer( 0 )
+	, mResolveFramebuffers( std::max( numBuffers, 1 ), 0 )
+	, mResolveTextures( std::max( numBuffers, 1 ), 0 )
+	, mBuffer( 0 )
+{
+	GLenum depthAttachment = mHasStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+	bool complete = true;
+
+	// may be created mid-session, so the bindings go through Cinder's context, which restores its cached ones afterwards
+	auto ctx = gl::context();
+	gl::ScopedRenderbuffer scopedRenderbuffer( GL_RENDERBUFFER, 0 );
+	gl::ScopedFramebuffer scopedFramebuffer( GL_FRAMEBUFFER, 0 );
+	gl::ScopedTextureBind scopedTexture( GL_TEXTURE_2D, 0 );
+
+	// multisampled targets own the depth, direct targets share it between their resolve framebuffers
+	glGenRenderbuffers( 1, &mDepthBuffer );
+	ctx->bindRenderbuffer( GL_RENDERBUFFER, mDepthBuffer );
+	if( isMultisampled() ) {
+		glRenderbufferStorageMultisample( GL_RENDERBUFFER, mSamples, depthFormat, mSize.x, mSize.y );
+
+		glGenRenderbuffers( 1, &mColorBuffer );
+		ctx->bindRenderbuffer( GL_RENDERBUFFER, mColorBuffer );
+		glRenderbufferStorageMultisample( GL_RENDERBUFFER, mSamples, colorFormat, mSize.x, mSize.y );
+
+		glGenFramebuffers( 1, &mRenderFramebuffer );
+		ctx->bindFramebuffer( GL_FRAMEBUFFER, mRenderFramebuffer );
+		glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColorBuffer );
+		glFramebufferRenderbuffer( GL_FRAMEBUFFER, depthAttachment, GL_RENDERBUFFER, mDepthBuffer );
+		complete = glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
+	}
+	else {
+		glRenderbufferStorage( GL_RENDERBUFFER, depthFormat, mSize.x, mSize.y );
 	}
 
-	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	glGenFramebuffers( (GLsizei)mResolveFramebuffers.size(), mResolveFramebuffers.data() );
+	glGenTextures( (GLsizei)mResolveTextures.size(), mResolveTextures.data() );
+	for( size_t i = 0; i < mResolveTextures.size() && complete; ++i ) {
+		ctx->bindTexture( GL_TEXTURE_2D, mResolveTextures[i] );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0 );
+		glTexImage2D( GL_TEXTURE_2D, 0, colorFormat, mSize.x, mSize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+
+		ctx->bindFramebuffer( GL_FRAMEBUFFER, mResolveFramebuffers[i] );
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mResolveTextures[i], 0 );
+		if( ! isMultisampled() ) {
+			glFramebufferRenderbuffer( GL_FRAMEBUFFER, depthAttachment, GL_RENDERBUFFER, mDepthBuffer );
+		}
+		complete = glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
+	}
 
-	return true;
+	if( ! complete ) {
+		destroy();
+		throw ViveExeption{ "Unable to create a " + toString( mSize.x ) + "x" + toString( mSize.y ) + " render target with " + toString( mSamples ) + " samples, check the color and depth formats." };
+	}
 }
 
-void HtcVive::setupStereoRenderTargets()
+RenderTarget::~RenderTarget()
 {
-	mHMD->GetRecommendedRenderTargetSize( &mRenderSize.x, &mRenderSize.y );
-	CreateFrameBuffer( mRenderSize.x, mRenderSize.y, leftEyeDesc );
-	CreateFrameBuffer( mRenderSize.x, mRenderSize.y, rightEyeDesc );
+	destroy();
 }
 
-void HtcVive::setupDistortion()
+void RenderTarget::destroy()
 {
-	GLushort m_iLensGridSegmentCountH = 43;
-	GLushort m_iLensGridSegmentCountV = 43;
-
-	float w = (float)(1.0 / float( m_iLensGridSegmentCountH - 1 ));
-	float h = (float)(1.0 / float( m_iLensGridSegmentCountV - 1 ));
+	glDeleteFramebuffers( (GLsizei)mResolveFramebuffers.size(), mResolveFramebuffers.data() );
+	glDeleteTextures( (GLsizei)mResolveTextures.size(), mResolveTextures.data() );
+	glDeleteFramebuffers( 1, &mRenderFramebuffer );
+	glDeleteRenderbuffers( 1, &mColorBuffer );
+	glDeleteRenderbuffers( 1, &mDepthBuffer );
+}
 
-	float u, v = 0;
+void RenderTarget::resolve( const ivec2 & size, GlStateCache & state )
+{
+	GLenum depthAttachment = mHasStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+	const GLenum attachments[] = { GL_COLOR_ATTACHMENT0, depthAttachment };
+	GLuint invalidated = isMultisampled() ? mRenderFramebuffer : mResolveFramebuffers[mBuffer];
+	GLsizei numInvalidated = isMultisampled() ? 2 : 1;
+
+	// direct state access leaves the framebuffer bindings alone
+	if( state.hasDirectStateAccess() ) {
+		if( isMultisampled() ) {
+			glBlitNamedFramebuffer( mRenderFramebuffer, mResolveFramebuffers[mBuffer], 0, 0, size.x, size.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_LINEAR );
+			state.countCalls();
+		}
+		glInvalidateNamedFramebufferData( invalidated, numInvalidated, isMultisampled() ? attachments : &depthAttachment );
+		state.countCalls();
+		return;
+	}
 
-	std::vector<VertexDataLens> vVerts( 0 );
-	VertexDataLens vert;
+	if( isMultisampled() ) {
+		state.bindFramebuffer( GL_READ_FRAMEBUFFER, mRenderFramebuffer );
+		state.bindFramebuffer( GL_DRAW_FRAMEBUFFER, mResolveFramebuffers[mBuffer] );
+		glBlitFramebuffer( 0, 0, size.x, size.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_LINEAR );
+		state.countCalls();
+	}
+	if( mCanInvalidate ) {
+		state.bindFramebuffer( GL_READ_FRAMEBUFFER, invalidated );
+		glInvalidateFramebuffer( GL_READ_FRAMEBUFFER, numInvalidated, isMultisampled() ? attachments : &depthAttachment );
+		state.countCalls();
+	}
+}
 
-	//left eye distortion verts
-	float Xoffset = -1;
-	for( int y = 0; y<m_iLensGridSegmentCountV; y++ )
-	{
-		for( int x = 0; x<m_iLensGridSegmentCountH; x++ )
-		{
-			u = x*w; v = 1 - y*h;
-			vert.position = glm::vec2( Xoffset + u, -1 + 2 * y*h );
+std::unique_ptr<RenderTarget> HtcVive::createRenderTarget( const ivec2 & size ) const
+{
+	std::unique_ptr<RenderTarget> target{ new RenderTarget( size, mOptions.getMsaaSamples(), mOptions.getColorFormat(), mOptions.getDepthFormat(), mNumResolveBuffers ) };
+	// a target created mid-frame has to resolve into the buffer already in use
+	target->select( mResolveBuffer );
+	return target;
+}
 
-			vr::DistortionCoordinates_t dc0 = mHMD->ComputeDistortion( vr::Eye_Left, u, v );
+void HtcVive::selectResolveBuffer( int buffer )
+{
+	mResolveBuffer = buffer;
+	for( auto & target : mEyeTargets ) {
+		if( target )
+			target->select( buffer );
+	}
+	if( mDoubleWideTarget ) {
+		mDoubleWideTarget->select( buffer );
+	}
+}
 
-			vert.texCoordRed = glm::vec2( dc0.rfRed[0], 1 - dc0.rfRed[1] );
-			vert.texCoordGreen = glm::vec2( dc0.rfGreen[0], 1 - dc0.rfGreen[1] );
-			vert.texCoordBlue = glm::vec2( dc0.rfBlue[0], 1 - dc0.rfBlue[1] );
+void HtcVive::setupStereoRenderTargets()
+{
+	mHMD->GetRecommendedRenderTargetSize( &mRenderSize.x, &mRenderSize.y );
+	mViewportSize = mRenderSize;
+	mResolutionScaler.setBudgetMs( 0.9 * 1000.0 / mDisplayFrequency );
+
+	// pipelined submit resolves the next frame while the compositor thread still reads the previous one
+	mNumResolveBuffers = std::max( mOptions.getResolveBuffers(), mOptions.isPipelinedSubmit() ? 2 : 1 );
+	if( mOptions.isSharedEyeTarget() ) {
+		setupSinglePassStereo();
+		mFrameIsDoubleWide = true;
+	}
+	else {
+		mEyeTargets[vr::Eye_Left] = createRenderTarget( ivec2( mRenderSize ) );
+		mEyeTargets[vr::Eye_Right] = createRenderTarget( ivec2( mRenderSize ) );
+	}
+}
 
-			vVerts.push_back( vert );
-		}
+void HtcVive::getSubmitBounds( vr::VRTextureBounds_t * bounds ) const
+{
+	// the eyes are drawn into the bottom left mViewportSize of their targets, side by side when double-wide
+	float u = float( mViewportSize.x ) / mRenderSize.x;
+	float v = float( mViewportSize.y ) / mRenderSize.y;
+	if( mFrameIsDoubleWide ) {
+		vr::VRTextureBounds_t left = { 0.0f, 0.0f, 0.5f * u, v };
+		vr::VRTextureBounds_t right = { 0.5f * u, 0.0f, u, v };
+		bounds[vr::Eye_Left] = left;
+		bounds[vr::Eye_Right] = right;
+	}
+	else {
+		vr::VRTextureBounds_t eye = { 0.0f, 0.0f, u, v };
+		bounds[vr::Eye_Left] = eye;
+		bounds[vr::Eye_Right] = eye;
 	}
+}
 
-	//right eye distortion verts
-	Xoffset = 0;
-	for( int y = 0; y<m_iLensGridSegmentCountV; y++ )
-	{
-		for( int x = 0; x<m_iLensGridSegmentCountH; x++ )
-		{
-			u = x*w; v = 1 - y*h;
-			vert.position = glm::vec2( Xoffset + u, -1 + 2 * y*h );
+void HtcVive::setupSinglePassStereo()
+{
+	mDoubleWideTarget = createRenderTarget( ivec2( 2 * mRenderSize.x, mRenderSize.y ) );
+}
 
-			vr::DistortionCoordinates_t dc0 = mHMD->ComputeDistortion( vr::Eye_Right, u, v );
+std::string HtcVive::getSinglePassShaderPreamble()
+{
+	return
+		"#version 410 core\n"
+		"layout(std140) uniform ViveStereo\n"
+		"{\n"
+		"	mat4 uViveViewMatrix[2];\n"
+		"	mat4 uViveProjectionMatrix[2];\n"
+		"	mat4 uViveViewProjectionMatrix[2];\n"
+		"	mat4 uViveDevicePose[16];\n"
+		"};\n"
+		"int viveStereoEye() { return gl_InstanceID % 2; }\n"
+		"int viveStereoInstance() { return gl_InstanceID / 2; }\n"
+		"vec4 viveStereoClipPosition( vec4 worldPosition )\n"
+		"{\n"
+		"	int eye = viveStereoEye();\n"
+		"	vec4 clipPos = uViveViewProjectionMatrix[eye] * worldPosition;\n"
+		"	clipPos.x = clipPos.x * 0.5 + ( eye == 0 ? -0.5 : 0.5 ) * clipPos.w;\n"
+		"	gl_ClipDistance[0] = ( eye == 0 ) ? -clipPos.x : clipPos.x;\n"
+		"	return clipPos;\n"
+		"}\n";
+}
 
-			vert.texCoordRed = glm::vec2( dc0.rfRed[0], 1 - dc0.rfRed[1] );
-			vert.texCoordGreen = glm::vec2( dc0.rfGreen[0], 1 - dc0.rfGreen[1] );
-			vert.texCoordBlue = glm::vec2( dc0.rfBlue[0], 1 - dc0.rfBlue[1] );
+std::string HtcVive::getMultiPassShaderPreamble()
+{
+	return
+		"#version 410 core\n"
+		"layout(std140) uniform ViveEye\n"
+		"{\n"
+		"	mat4 uViveViewMatrix;\n"
+		"	mat4 uViveProjectionMatrix;\n"
+		"	mat4 uViveViewProjectionMatrix;\n"
+		"	mat4 uViveDevicePose[16];\n"
+		"};\n";
+}
 
-			vVerts.push_back( vert );
-		}
+void HtcVive::setupDistortion()
+{
+	// each eye's grid must be addressable with 16-bit indices
+	ivec2 gridSize = glm::clamp( mOptions.getLensGridSize(), ivec2( 2 ), ivec2( 181 ) );
+	if( gridSize != mOptions.getLensGridSize() ) {
+		CI_LOG_W( "Lens grid size clamped to " << gridSize.x << "x" << gridSize.y );
+	}
+	GLushort m_iLensGridSegmentCountH = gridSize.x;
+	GLushort m_iLensGridSegmentCountV = gridSize.y;
+
+	std::vector<VertexDataLens> vVerts( 2 * m_iLensGridSegmentCountH * m_iLensGridSegmentCountV );
+
+	// the distortion only depends on the headset and the grid, so it is computed once per headset
+	std::stringstream key;
+	key << mDriver << "|" << mDisplay << "|" << gridSize.x << "x" << gridSize.y;
+	uint64_t keyHash = HashString( key.str() );
+	fs::path cachePath;
+	if( ! mOptions.getCacheDirectory().empty() ) {
+		cachePath = mOptions.getCacheDirectory() / "Distortion" / ( SanitizeFileName( mDriver + "_" + mDisplay ) + ".cvld" );
 	}
 
-	std::vector<GLushort> vIndices;
-	GLushort a, b, c, d;
-
-	GLushort offset = 0;
-	for( GLushort y = 0; y<m_iLensGridSegmentCountV - 1; y++ )
-	{
-		for( GLushort x = 0; x<m_iLensGridSegmentCountH - 1; x++ )
-		{
-			a = m_iLensGridSegmentCountH*y + x + offset;
-			b = m_iLensGridSegmentCountH*y + x + 1 + offset;
-			c = (y + 1)*m_iLensGridSegmentCountH + x + 1 + offset;
-			d = (y + 1)*m_iLensGridSegmentCountH + x + offset;
-			vIndices.push_back( a );
-			vIndices.push_back( b );
-			vIndices.push_back( c );
-
-			vIndices.push_back( a );
-			vIndices.push_back( c );
-			vIndices.push_back( d );
+	if( cachePath.empty() || ! ReadLensCache( cachePath, keyHash, vVerts ) ) {
+		computeDistortion( gridSize, vVerts.data() );
+		if( ! cachePath.empty() ) {
+			try {
+				fs::create_directories( cachePath.parent_path() );
+				WriteLensCache( cachePath, keyHash, vVerts );
+			}
+			catch( const std::exception & exc ) {
+				CI_LOG_W( "Unable to cache lens distortion: " << exc.what() );
+			}
 		}
 	}
 
-	offset = (m_iLensGridSegmentCountH)*(m_iLensGridSegmentCountV);
-	for( GLushort y = 0; y<m_iLensGridSegmentCountV - 1; y++ )
+	std::vector<GLushort> vIndices( 2 * 6 * ( m_iLensGridSegmentCountH - 1 ) * ( m_iLensGridSegmentCountV - 1 ) );
+	GLushort a, b, c, d;
+
+	size_t i = 0;
+	for( int eye = vr::Eye_Left; eye <= vr::Eye_Right; eye++ )
 	{
-		for( GLushort x = 0; x<m_iLensGridSegmentCountH - 1; x++ )
+		GLushort offset = eye * m_iLensGridSegmentCountH * m_iLensGridSegmentCountV;
+		for( GLushort y = 0; y<m_iLensGridSegmentCountV - 1; y++ )
 		{
-			a = m_iLensGridSegmentCountH*y + x + offset;
-			b = m_iLensGridSegmentCountH*y + x + 1 + offset;
-			c = (y + 1)*m_iLensGridSegmentCountH + x + 1 + offset;
-			d = (y + 1)*m_iLensGridSegmentCountH + x + offset;
-			vIndices.push_back( a );
-			vIndices.push_back( b );
-			vIndices.push_back( c );
-
-			vIndices.push_back( a );
-			vIndices.push_back( c );
-			vIndices.push_back( d );
+			for( GLushort x = 0; x<m_iLensGridSegmentCountH - 1; x++ )
+			{
+				a = m_iLensGridSegmentCountH*y + x + offset;
+				b = m_iLensGridSegmentCountH*y + x + 1 + offset;
+				c = (y + 1)*m_iLensGridSegmentCountH + x + 1 + offset;
+				d = (y + 1)*m_iLensGridSegmentCountH + x + offset;
+				vIndices[i++] = a;
+				vIndices[i++] = b;
+				vIndices[i++] = c;
+
+				vIndices[i++] = a;
+				vIndices[i++] = c;
+				vIndices[i++] = d;
+			}
 		}
 	}
 	m_uiIndexSize = vIndices.size();
 
-	glGenVertexArrays( 1, &m_unLensVAO );
-	glBindVertexArray( m_unLensVAO );
+	mLensVao = gl::Vao::create();
+	gl::ScopedVao scopedVao{ mLensVao };
 
 	glGenBuffers( 1, &m_glIDVertBuffer );
 	glBindBuffer( GL_ARRAY_BUFFER, m_glIDVertBuffer );
@@ -391,15 +3021,201 @@ void HtcVive::setupDistortion()
 	glEnableVertexAttribArray( 3 );
 	glVertexAttribPointer( 3, 2, GL_FLOAT, GL_FALSE, sizeof( VertexDataLens ), (void *)offsetof( VertexDataLens, texCoordBlue ) );
 
-	glBindVertexArray( 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	// the lens and mirror passes sample the resolve textures through this instead of setting their parameters every frame
+	glGenSamplers( 1, &mLensSampler );
+	glSamplerParameteri( mLensSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glSamplerParameteri( mLensSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glSamplerParameteri( mLensSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glSamplerParameteri( mLensSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+}
+
+void HtcVive::setupHiddenAreaMesh()
+{
+	std::vector<vr::HmdVector2_t> vertices;
+	for( int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye ) {
+		vr::HiddenAreaMesh_t mesh = mHMD->GetHiddenAreaMesh( static_cast<vr::Hmd_Eye>( eye ) );
+		mHiddenAreaFirst[eye] = (GLint)vertices.size();
+		mHiddenAreaCount[eye] = mesh.pVertexData ? 3 * mesh.unTriangleCount : 0;
+		vertices.insert( vertices.end(), mesh.pVertexData, mesh.pVertexData + mHiddenAreaCount[eye] );
+
+		float area = 0;
+		for( GLsizei i = 0; i + 2 < mHiddenAreaCount[eye]; i += 3 ) {
+			const float * a = mesh.pVertexData[i].v;
+			const float * b = mesh.pVertexData[i + 1].v;
+			const float * c = mesh.pVertexData[i + 2].v;
+			area += std::abs( ( b[0] - a[0] ) * ( c[1] - a[1] ) - ( c[0] - a[0] ) * ( b[1] - a[1] ) ) * 0.5f;
+		}
+		mHiddenAreaFraction[eye] = std::min( area, 1.0f );
+	}
 
-	glDisableVertexAttribArray( 0 );
-	glDisableVertexAttribArray( 1 );
-	glDisableVertexAttribArray( 2 );
-	glDisableVertexAttribArray( 3 );
+	if( vertices.empty() ) {
+		CI_LOG_I( "No hidden-area mesh for this headset." );
+		return;
+	}
 
-	glBindBuffer( GL_ARRAY_BUFFER, 0 );
-	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+	mHiddenAreaVbo = gl::Vbo::create( GL_ARRAY_BUFFER, vertices.size() * sizeof( vr::HmdVector2_t ), vertices.data(), GL_STATIC_DRAW );
+	mHiddenAreaVao = gl::Vao::create();
+	gl::ScopedVao scopedVao{ mHiddenAreaVao };
+	gl::ScopedBuffer scopedBuffer{ mHiddenAreaVbo };
+	gl::enableVertexAttribArray( 0 );
+	gl::vertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, sizeof( vr::HmdVector2_t ), nullptr );
+}
+
+void HtcVive::enableHiddenAreaMask( bool enable )
+{
+	const RenderTarget & target = mEyeTargets[vr::Eye_Left] ? *mEyeTargets[vr::Eye_Left] : *mDoubleWideTarget;
+	if( enable && ! target.hasStencil() ) {
+		CI_LOG_W( "The hidden area mask needs a depth format with stencil, see Options::depthFormat()." );
+		return;
+	}
+	if( enable && ! mHiddenAreaMask )
+		mHiddenAreaPixelsSaved = 0;
+	mHiddenAreaMask = enable;
+}
+
+void HtcVive::renderHiddenAreaStencil( vr::Hmd_Eye eye, float pixelScale )
+{
+	if( mHiddenAreaCount[eye] == 0 )
+		return;
+
+	gl::ScopedVao scopedVao{ mHiddenAreaVao };
+	gl::ScopedGlslProg scopedGlsl{ mGlslHiddenArea };
+	gl::ScopedDepth scopedDepth{ false };
+	gl::ScopedFaceCulling scopedCulling{ false };
+	mGlState.colorMask( false, false, false, false );
+	mGlState.enable( GL_STENCIL_TEST );
+	mGlState.stencilFunc( GL_ALWAYS, 1, 0xFF );
+	mGlState.stencilOp( GL_KEEP, GL_KEEP, GL_REPLACE );
+	gl::drawArrays( GL_TRIANGLES, mHiddenAreaFirst[eye], mHiddenAreaCount[eye] );
+	mGlState.countCalls();
+	mGlState.colorMask( true, true, true, true );
+
+	// renderScene() then only touches pixels left at 0
+	mGlState.stencilFunc( GL_EQUAL, 0, 0xFF );
+	mGlState.stencilOp( GL_KEEP, GL_KEEP, GL_KEEP );
+
+	mHiddenAreaPixelsSaved += (uint64_t)( mHiddenAreaFraction[eye] * mViewportSize.x * mViewportSize.y * pixelScale );
+}
+
+void HtcVive::enableFixedFoveation( bool enable, float radius, float peripheralScale )
+{
+	if( enable && mOptions.isSharedEyeTarget() ) {
+		CI_LOG_W( "Fixed foveation needs per-eye targets and is ignored with Options::sharedEyeTarget()." );
+		return;
+	}
+
+	mFoveation = enable;
+	mFoveationRadius = glm::clamp( radius, 0.0f, 0.5f );
+	mFoveationScale = glm::clamp( peripheralScale, 0.1f, 1.0f );
+
+	ivec2 size = glm::max( ivec2( vec2( mRenderSize ) * mFoveationScale + vec2( 0.5f ) ), ivec2( 1 ) );
+	if( ! mFoveation )
+		mPeripheryTarget.reset();
+	else if( ! mPeripheryTarget || mPeripheryTarget->getSize() != size ) {
+		// usually toggled from the app's input handling, so a target the GPU cannot create only leaves foveation off
+		try {
+			mPeripheryTarget.reset( new RenderTarget( size, mOptions.getMsaaSamples(), mOptions.getColorFormat(), mOptions.getDepthFormat(), 1 ) );
+		}
+		catch( const std::exception & exc ) {
+			CI_LOG_E( "Fixed foveation disabled: " << exc.what() );
+			mPeripheryTarget.reset();
+			mFoveation = false;
+		}
+	}
+
+	if( mPeripheryTarget && ! mPeripheryTarget->hasStencil() )
+		CI_LOG_W( "Fixed foveation needs a depth format with stencil to skip the center in the periphery pass." );
+}
+
+void HtcVive::renderFoveatedPeriphery( vr::Hmd_Eye eye, FunctionRef<void( vr::Hmd_Eye )> renderScene )
+{
+	// the lens axis projects off the image center on most headsets
+	vec4 axis = gl::getProjectionMatrix() * vec4( 0, 0, -1, 1 );
+	vec2 center = ( vec2( axis ) / axis.w * 0.5f + vec2( 0.5f ) ) * vec2( mViewportSize );
+	vec2 extent = mFoveationRadius * vec2( mViewportSize );
+	ivec2 lower = glm::clamp( ivec2( center - extent ), ivec2( 0 ), ivec2( mViewportSize ) );
+	ivec2 upper = glm::clamp( ivec2( center + extent ), ivec2( 0 ), ivec2( mViewportSize ) );
+
+	// the periphery at reduced resolution, where the hidden area lies
+	ivec2 size = glm::max( ivec2( vec2( mViewportSize ) * mFoveationScale + vec2( 0.5f ) ), ivec2( 1 ) );
+	mGlState.bindFramebuffer( GL_FRAMEBUFFER, mPeripheryTarget->getRenderFramebuffer() );
+	mGlState.viewport( ivec2( 0 ), size );
+	if( mPeripheryTarget->hasStencil() ) {
+		mGlState.clear( GL_STENCIL_BUFFER_BIT );
+
+		// the center is covered at full resolution, except for the border texels the stretched periphery filters with
+		vec2 toPeriphery = vec2( size ) / vec2( mViewportSize );
+		ivec2 innerLower = ivec2( glm::ceil( vec2( lower ) * toPeriphery ) ) + ivec2( 1 );
+		ivec2 innerUpper = ivec2( glm::floor( vec2( upper ) * toPeriphery ) ) - ivec2( 1 );
+		if( innerUpper.x > innerLower.x && innerUpper.y > innerLower.y ) {
+			mGlState.enable( GL_SCISSOR_TEST );
+			mGlState.scissor( innerLower, innerUpper - innerLower );
+			mGlState.clearStencil( 1 );
+			mGlState.enable( GL_SCISSOR_TEST, false );
+		}
+		if( mHiddenAreaMask )
+			renderHiddenAreaStencil( eye, mFoveationScale * mFoveationScale );
+
+		mGlState.enable( GL_STENCIL_TEST );
+		mGlState.stencilFunc( GL_EQUAL, 0, 0xFF );
+		mGlState.stencilOp( GL_KEEP, GL_KEEP, GL_KEEP );
+	}
+	renderScene( eye );
+	renderController( eye );
+	renderLayers();
+	mGlState.enable( GL_STENCIL_TEST, false );
+	mPeripheryTarget->resolve( size, mGlState );
+
+	// stretched over the eye target, which then only gets the center rectangle at full resolution
+	mGlState.bindFramebuffer( GL_FRAMEBUFFER, mEyeTargets[eye]->getRenderFramebuffer() );
+	mGlState.viewport( ivec2( 0 ), ivec2( mViewportSize ) );
+	drawMirrorQuad( mPeripheryTarget->getResolveTexture(), vec4( -1, -1, 1, 1 ), vec4( vec2( 0 ), vec2( size ) / vec2( mPeripheryTarget->getSize() ) ) );
+
+	mGlState.enable( GL_SCISSOR_TEST );
+	mGlState.scissor( lower, upper - lower );
+}
+
+void HtcVive::computeDistortion( const ivec2 & gridSize, VertexDataLens * verts )
+{
+	float w = (float)(1.0 / float( gridSize.x - 1 ));
+	float h = (float)(1.0 / float( gridSize.y - 1 ));
+
+	// rows of both eyes are independent, so they are spread over all cores
+	auto computeRows = [=]( int rowBegin, int rowEnd ) {
+		for( int row = rowBegin; row < rowEnd; row++ )
+		{
+			vr::Hmd_Eye eye = row < gridSize.y ? vr::Eye_Left : vr::Eye_Right;
+			float Xoffset = eye == vr::Eye_Left ? -1.0f : 0.0f;
+			int y = row % gridSize.y;
+			VertexDataLens * vert = verts + row * gridSize.x;
+			for( int x = 0; x<gridSize.x; x++, vert++ )
+			{
+				float u = x*w;
+				float v = 1 - y*h;
+				vert->position = glm::vec2( Xoffset + u, -1 + 2 * y*h );
+
+				vr::DistortionCoordinates_t dc0 = mHMD->ComputeDistortion( eye, u, v );
+
+				vert->texCoordRed = glm::vec2( dc0.rfRed[0], 1 - dc0.rfRed[1] );
+				vert->texCoordGreen = glm::vec2( dc0.rfGreen[0], 1 - dc0.rfGreen[1] );
+				vert->texCoordBlue = glm::vec2( dc0.rfBlue[0], 1 - dc0.rfBlue[1] );
+			}
+		}
+	};
+
+	int numRows = 2 * gridSize.y;
+	int numThreads = std::max( 1, std::min( (int)std::thread::hardware_concurrency(), numRows ) );
+	int rowsPerThread = ( numRows + numThreads - 1 ) / numThreads;
+	std::vector<std::thread> threads;
+	for( int rowBegin = rowsPerThread; rowBegin < numRows; rowBegin += rowsPerThread ) {
+		threads.emplace_back( computeRows, rowBegin, std::min( rowBegin + rowsPerThread, numRows ) );
+	}
+	computeRows( 0, std::min( rowsPerThread, numRows ) );
+	for( auto & thread : threads ) {
+		thread.join();
+	}
 }
 
 void HtcVive::setupCameras()
@@ -412,6 +3228,15 @@ void HtcVive::setupCameras()
 
 void HtcVive::setupRenderModels()
 {
+	// cached models are reused as long as the tracking system, its driver build and the render model interface stay
+	// the same; runtimes that don't report a driver version fall back to the interface version alone, which misses
+	// model updates shipped without an interface change
+	std::string driverVersion = GetTrackedDeviceString( mHMD, vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_DriverVersion_String );
+	std::string runtimeKey = mDriver + "|" + driverVersion + "|" + vr::IVRRenderModels_Version;
+	fs::path cacheDirectory = mOptions.getCacheDirectory().empty() ? fs::path() : mOptions.getCacheDirectory() / "RenderModels";
+	mRenderModelBatch.reset( new RenderModelBatch( mOptions.isCompressRenderModelTextures() ) );
+	mRenderModelLoader.reset( new RenderModelLoader{ m_pRenderModels, mRenderModelBatch.get(), cacheDirectory, runtimeKey } );
+
 	for( auto id = vr::k_unTrackedDeviceIndex_Hmd + 1; id < vr::k_unMaxTrackedDeviceCount; id++ ) {
 		if( !mHMD->IsTrackedDeviceConnected( id ) )
 			continue;
@@ -425,17 +3250,16 @@ void HtcVive::setupRenderModelForTrackedDevice( vr::TrackedDeviceIndex_t unTrack
 	if( unTrackedDeviceIndex >= vr::k_unMaxTrackedDeviceCount )
 		return;
 
-	// try to find a model we've already set up
 	std::string sRenderModelName = GetTrackedDeviceString( mHMD, unTrackedDeviceIndex, vr::Prop_RenderModelName_String );
-	auto renderModel = findOrLoadRenderModel( sRenderModelName );
-	if( !renderModel ) {
+	if( sRenderModelName.empty() ) {
 		std::string sTrackingSystemName = GetTrackedDeviceString( mHMD, unTrackedDeviceIndex, vr::Prop_TrackingSystemName_String );
-		CI_LOG_E( "Unable to load render model for tracked device " << unTrackedDeviceIndex << " " << sTrackingSystemName << " " << sRenderModelName );
-	}
-	else {
-		mTrackedDeviceToRenderModel[unTrackedDeviceIndex] = renderModel;
-		mShowTrackedDevice[unTrackedDeviceIndex] = true;
+		CI_LOG_E( "No render model for tracked device " << unTrackedDeviceIndex << " " << sTrackingSystemName );
+		return;
 	}
+
+	// cached models are shared right away; new ones load in the background and draw as a placeholder until ready
+	mTrackedDeviceToRenderModel[unTrackedDeviceIndex] = mRenderModelLoader->request( sRenderModelName );
+	mShowTrackedDevice[unTrackedDeviceIndex] = true;
 }
 
 void hmd::HtcVive::setupCompositor()
@@ -443,30 +3267,103 @@ void hmd::HtcVive::setupCompositor()
 	if( !vr::VRCompositor() ) {
 		throw ViveExeption{ "Compositor initialization failed. See log file for details." };
 	}
+
+	if( mOptions.isPipelinedSubmit() ) {
+		mCompositorThread.reset( new CompositorThread( vr::VRCompositor(), gl::Context::create( gl::context() ), mNumResolveBuffers ) );
+	}
 }
 
-void hmd::HtcVive::renderController( const vr::Hmd_Eye& eye )
+void HtcVive::gatherDeviceInstances()
 {
-	bool inputCapturedByAnotherProcess = mHMD->IsInputFocusCapturedByAnotherProcess();
+	mRenderModelBatch->clear();
+	mPlaceholderDevices.clear();
 
+	bool inputCapturedByAnotherProcess = mHMD->IsInputFocusCapturedByAnotherProcess();
 	for( uint32_t i = 0; i < vr::k_unMaxTrackedDeviceCount; i++ )
 	{
-		if( /* ! mTrackedDeviceToRenderModel[i] || */ ! mShowTrackedDevice[i] )
+		if( ! mShowTrackedDevice[i] || ! mTrackedDevicePose[i].bPoseIsValid )
 			continue;
 
-		const vr::TrackedDevicePose_t & pose = mTrackedDevicePose[i];
-		if( !pose.bPoseIsValid )
+		// the device class was cached with the pose
+		if( inputCapturedByAnotherProcess && m_rDevClassChar[i] == 'C' )
 			continue;
 
-		if( inputCapturedByAnotherProcess && mHMD->GetTrackedDeviceClass( i ) == vr::TrackedDeviceClass_Controller )
+		const auto & renderModel = mTrackedDeviceToRenderModel[i];
+		if( renderModel && renderModel->isReady() )
+			mRenderModelBatch->addInstance( renderModel->getSlot(), mDevicePose[i] );
+		else
+			mPlaceholderDevices.push_back( i );
+	}
+}
+
+void hmd::HtcVive::renderController( const vr::Hmd_Eye& eye )
+{
+	mRenderModelBatch->draw();
+
+	// placeholders until the render models are loaded
+	for( auto i : mPlaceholderDevices ) {
+		gl::ScopedModelMatrix push;
+		gl::setModelMatrix( mDevicePose[i] );
+		gl::drawCoordinateFrame( 0.3f, 0.06f, 0.01f );
+	}
+}
+
+LayerRef HtcVive::addLayer( const ivec2 & size, const std::function<void()> & render, int updateInterval )
+{
+	LayerRef layer{ new Layer{ size, render, updateInterval } };
+	mLayers.push_back( layer );
+	return layer;
+}
+
+void HtcVive::removeLayer( const LayerRef & layer )
+{
+	mLayers.erase( std::remove( mLayers.begin(), mLayers.end(), layer ), mLayers.end() );
+}
+
+void HtcVive::updateLayers()
+{
+	mLayersRendered = 0;
+	++mLayerFrame;
+	for( size_t i = 0; i < mLayers.size(); ++i ) {
+		Layer & layer = *mLayers[i];
+		// offset by the index so that layers sharing an interval take turns
+		bool due = layer.mUpdateInterval > 0 && ( mLayerFrame + i ) % layer.mUpdateInterval == 0;
+		if( ! layer.mVisible || ! ( layer.mDirty || due ) )
 			continue;
-		{
-			gl::ScopedModelMatrix push;
-			gl::setModelMatrix( mDevicePose[i] );
-			gl::drawCoordinateFrame( 0.3f, 0.06f, 0.01f );
-		}
 
-		//mTrackedDeviceToRenderModel[i]->draw(); //TODO: Fix render!
+		ivec2 size = layer.mFbo->getSize();
+		gl::ScopedFramebuffer fbo( layer.mFbo );
+		gl::ScopedViewport viewport( ivec2( 0 ), size );
+		gl::ScopedMatrices matrices;
+		gl::setMatricesWindow( size );
+		gl::clear( ColorA( 0, 0, 0, 0 ) );
+		// alpha blending over transparent black leaves premultiplied color, as long as alpha adds up as coverage
+		gl::ScopedBlend blend( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+		layer.mRender();
+
+		layer.mDirty = false;
+		++layer.mRenderCount;
+		++mLayersRendered;
+	}
+}
+
+void HtcVive::renderLayers()
+{
+	if( mLayers.empty() )
+		return;
+
+	gl::ScopedBlendPremult blend;
+	gl::ScopedDepthWrite depthWrite( false );
+	for( const auto & layer : mLayers ) {
+		if( ! layer->mVisible || layer->mRenderCount == 0 )
+			continue;
+
+		gl::ScopedDepthTest depthTest( layer->mDepthTested );
+		gl::ScopedModelMatrix push;
+		// head-locked layers undo the head pose of the view matrix, leaving only the eye offset
+		gl::setModelMatrix( layer->mSpace == Layer::SPACE_HEAD ? glm::inverse( m_mat4HMDPose ) * layer->mTransform : layer->mTransform );
+		// gl::draw() puts the top of the texture at the rectangle's y1, which is +y here
+		gl::draw( layer->mFbo->getColorTexture(), Rectf( -0.5f, 0.5f, 0.5f, -0.5f ) );
 	}
 }
 
@@ -492,89 +3389,262 @@ void HtcVive::processVREvent( const vr::VREvent_t & event )
 	}
 }
 
-void hmd::HtcVive::renderStereoTargets( std::function<void( vr::Hmd_Eye )> renderScene )
+void hmd::HtcVive::renderStereoTargets( FunctionRef<void( vr::Hmd_Eye )> renderScene )
 {
-	glEnable( GL_MULTISAMPLE );
-
-	// Left Eye
-	glBindFramebuffer( GL_FRAMEBUFFER, leftEyeDesc.m_nRenderFramebufferId );
-	glViewport( 0, 0, mRenderSize.x, mRenderSize.y );
-	{
-		gl::ScopedViewMatrix pushView;
-		gl::ScopedProjectionMatrix pushProj;
-		gl::setViewMatrix( m_mat4eyePosLeft * m_mat4HMDPose );
-		gl::setProjectionMatrix( m_mat4ProjectionLeft );
-		renderScene( vr::Eye_Left );
-		renderController( vr::Eye_Left );
+	if( mOptions.isSharedEyeTarget() ) {
+		renderStereoTargetsShared( renderScene );
+		return;
 	}
-	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
 
-	glDisable( GL_MULTISAMPLE );
+	mFrameIsDoubleWide = false;
+	mGlState.enable( GL_MULTISAMPLE );
+
+	for( int i = vr::Eye_Left; i <= vr::Eye_Right; ++i ) {
+		vr::Hmd_Eye eye = static_cast<vr::Hmd_Eye>( i );
+		mGlState.bindFramebuffer( GL_FRAMEBUFFER, mEyeTargets[eye]->getRenderFramebuffer() );
+		mGlState.viewport( ivec2( 0 ), ivec2( mViewportSize ) );
+		{
+			FrameProfiler::ScopedStage stage{ mProfiler, eye == vr::Eye_Left ? FrameProfiler::STAGE_SCENE_LEFT : FrameProfiler::STAGE_SCENE_RIGHT };
+			gl::ScopedViewMatrix pushView;
+			gl::ScopedProjectionMatrix pushProj;
+			gl::setViewMatrix( ( eye == vr::Eye_Left ? m_mat4eyePosLeft : m_mat4eyePosRight ) * m_mat4HMDPose );
+			LATENCY_MARK( markEyeConsumed( eye ) );
+			gl::setProjectionMatrix( eye == vr::Eye_Left ? m_mat4ProjectionLeft : m_mat4ProjectionRight );
+			mPoseUniforms->bindEye( eye, EYE_UNIFORM_BINDING );
+			if( mFoveation ) {
+				// the periphery pass already masked the hidden area, which lies outside the center
+				renderFoveatedPeriphery( eye, renderScene );
+			}
+			else if( mHiddenAreaMask ) {
+				mGlState.clear( GL_STENCIL_BUFFER_BIT );
+				renderHiddenAreaStencil( eye );
+			}
+			renderScene( eye );
+			renderController( eye );
+			renderLayers();
+			mGlState.enable( GL_STENCIL_TEST, false );
+			mGlState.enable( GL_SCISSOR_TEST, false );
+		}
 
-	glBindFramebuffer( GL_READ_FRAMEBUFFER, leftEyeDesc.m_nRenderFramebufferId );
-	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, leftEyeDesc.m_nResolveFramebufferId );
+		// blits ignore GL_MULTISAMPLE, so it stays on until both eyes are resolved
+		mProfiler.beginStage( FrameProfiler::STAGE_RESOLVE );
+		mEyeTargets[eye]->resolve( ivec2( mViewportSize ), mGlState );
+		mProfiler.endStage( FrameProfiler::STAGE_RESOLVE );
+		checkReprojectionWatchdog();
+	}
+
+	mGlState.bindFramebuffer( GL_FRAMEBUFFER, 0 );
+	mGlState.enable( GL_MULTISAMPLE, false );
+}
 
-	glBlitFramebuffer( 0, 0, mRenderSize.x, mRenderSize.y, 0, 0, mRenderSize.x, mRenderSize.y,
-		GL_COLOR_BUFFER_BIT,
-		GL_LINEAR );
+void HtcVive::renderStereoTargetsShared( FunctionRef<void( vr::Hmd_Eye )> renderScene )
+{
+	mFrameIsDoubleWide = true;
+	mGlState.enable( GL_MULTISAMPLE );
+
+	// Both eyes, one framebuffer: the scissor keeps each eye's clears inside its half
+	mGlState.bindFramebuffer( GL_FRAMEBUFFER, mDoubleWideTarget->getRenderFramebuffer() );
+	mGlState.enable( GL_SCISSOR_TEST );
+	for( int i = vr::Eye_Left; i <= vr::Eye_Right; ++i ) {
+		vr::Hmd_Eye eye = static_cast<vr::Hmd_Eye>( i );
+		mGlState.viewport( ivec2( i * mViewportSize.x, 0 ), ivec2( mViewportSize.x, mViewportSize.y ) );
+		mGlState.scissor( ivec2( i * mViewportSize.x, 0 ), ivec2( mViewportSize.x, mViewportSize.y ) );
+
+		FrameProfiler::ScopedStage stage{ mProfiler, eye == vr::Eye_Left ? FrameProfiler::STAGE_SCENE_LEFT : FrameProfiler::STAGE_SCENE_RIGHT };
+		gl::ScopedViewMatrix pushView;
+		gl::ScopedProjectionMatrix pushProj;
+		gl::setViewMatrix( ( eye == vr::Eye_Left ? m_mat4eyePosLeft : m_mat4eyePosRight ) * m_mat4HMDPose );
+		LATENCY_MARK( markEyeConsumed( eye ) );
+		gl::setProjectionMatrix( eye == vr::Eye_Left ? m_mat4ProjectionLeft : m_mat4ProjectionRight );
+		mPoseUniforms->bindEye( eye, EYE_UNIFORM_BINDING );
+		if( mHiddenAreaMask ) {
+			mGlState.clear( GL_STENCIL_BUFFER_BIT );
+			renderHiddenAreaStencil( eye );
+		}
+		renderScene( eye );
+		renderController( eye );
+		renderLayers();
+		mGlState.enable( GL_STENCIL_TEST, false );
+		checkReprojectionWatchdog();
+	}
+	mGlState.enable( GL_SCISSOR_TEST, false );
 
-	glBindFramebuffer( GL_READ_FRAMEBUFFER, 0 );
-	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
+	mProfiler.beginStage( FrameProfiler::STAGE_RESOLVE );
+	mDoubleWideTarget->resolve( ivec2( 2 * mViewportSize.x, mViewportSize.y ), mGlState );
+	mProfiler.endStage( FrameProfiler::STAGE_RESOLVE );
 
-	glEnable( GL_MULTISAMPLE );
+	mGlState.bindFramebuffer( GL_FRAMEBUFFER, 0 );
+	mGlState.enable( GL_MULTISAMPLE, false );
+}
 
-	// Right Eye
-	glBindFramebuffer( GL_FRAMEBUFFER, rightEyeDesc.m_nRenderFramebufferId );
-	glViewport( 0, 0, mRenderSize.x, mRenderSize.y );
+void hmd::HtcVive::renderStereoTargetsSinglePass( FunctionRef<void()> renderScene )
+{
+	if( ! mDoubleWideTarget ) {
+		CI_LOG_I( "Allocating double-wide target for single-pass stereo." );
+		setupSinglePassStereo();
+	}
+	mFrameIsDoubleWide = true;
+
+	mPoseUniforms->bindStereo( STEREO_UNIFORM_BINDING );
+	LATENCY_MARK( markEyeConsumed( vr::Eye_Left ) );
+	LATENCY_MARK( markEyeConsumed( vr::Eye_Right ) );
+
+	mGlState.enable( GL_MULTISAMPLE );
+
+	// Both eyes, one pass: instances are split across the halves by viveStereoClipPosition()
+	mGlState.bindFramebuffer( GL_FRAMEBUFFER, mDoubleWideTarget->getRenderFramebuffer() );
+	mGlState.viewport( ivec2( 0 ), ivec2( 2 * mViewportSize.x, mViewportSize.y ) );
+	mProfiler.beginStage( FrameProfiler::STAGE_SCENE_LEFT );
+	if( mHiddenAreaMask ) {
+		mGlState.clear( GL_STENCIL_BUFFER_BIT );
+		for( int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye ) {
+			mGlState.viewport( ivec2( eye * mViewportSize.x, 0 ), ivec2( mViewportSize.x, mViewportSize.y ) );
+			renderHiddenAreaStencil( static_cast<vr::Hmd_Eye>( eye ) );
+		}
+		mGlState.viewport( ivec2( 0 ), ivec2( 2 * mViewportSize.x, mViewportSize.y ) );
+	}
+	mGlState.enable( GL_CLIP_DISTANCE0 );
 	{
 		gl::ScopedViewMatrix pushView;
 		gl::ScopedProjectionMatrix pushProj;
-		gl::setViewMatrix( m_mat4eyePosRight * m_mat4HMDPose );
-		gl::setProjectionMatrix( m_mat4ProjectionRight );
-		renderScene( vr::Eye_Right );
-		renderController( vr::Eye_Right );
+		gl::setViewMatrix( mat4() );
+		gl::setProjectionMatrix( mat4() );
+		renderScene();
 	}
-	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
-
-	glDisable( GL_MULTISAMPLE );
+	mGlState.enable( GL_CLIP_DISTANCE0, false );
 
-	glBindFramebuffer( GL_READ_FRAMEBUFFER, rightEyeDesc.m_nRenderFramebufferId );
-	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, rightEyeDesc.m_nResolveFramebufferId );
+	// Controllers go through Cinder's stock shaders, so they are drawn per eye viewport
+	for( int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye ) {
+		mGlState.viewport( ivec2( eye * mViewportSize.x, 0 ), ivec2( mViewportSize.x, mViewportSize.y ) );
+		gl::ScopedViewMatrix pushView;
+		gl::ScopedProjectionMatrix pushProj;
+		gl::setViewMatrix( ( eye == vr::Eye_Left ? m_mat4eyePosLeft : m_mat4eyePosRight ) * m_mat4HMDPose );
+		gl::setProjectionMatrix( eye == vr::Eye_Left ? m_mat4ProjectionLeft : m_mat4ProjectionRight );
+		renderController( static_cast<vr::Hmd_Eye>( eye ) );
+		renderLayers();
+	}
+	mGlState.enable( GL_STENCIL_TEST, false );
+	mProfiler.endStage( FrameProfiler::STAGE_SCENE_LEFT );
 
-	glBlitFramebuffer( 0, 0, mRenderSize.x, mRenderSize.y, 0, 0, mRenderSize.x, mRenderSize.y,
-		GL_COLOR_BUFFER_BIT,
-		GL_LINEAR );
+	mProfiler.beginStage( FrameProfiler::STAGE_RESOLVE );
+	mDoubleWideTarget->resolve( ivec2( 2 * mViewportSize.x, mViewportSize.y ), mGlState );
+	mProfiler.endStage( FrameProfiler::STAGE_RESOLVE );
+	checkReprojectionWatchdog();
 
-	glBindFramebuffer( GL_READ_FRAMEBUFFER, 0 );
-	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
+	mGlState.bindFramebuffer( GL_FRAMEBUFFER, 0 );
+	mGlState.enable( GL_MULTISAMPLE, false );
 }
 
 void HtcVive::renderDistortion( const ivec2& windowSize )
 {
-	glDisable( GL_DEPTH_TEST );
-	glViewport( 0, 0, windowSize.x, windowSize.y );
+	FrameProfiler::ScopedStage stage{ mProfiler, FrameProfiler::STAGE_DISTORTION };
+
+	mGlState.enable( GL_DEPTH_TEST, false );
+	mGlState.viewport( ivec2( 0 ), windowSize );
 
-	glBindVertexArray( m_unLensVAO );
-	glUseProgram( mGlslLens->getHandle() );
+	mGlState.bindVao( mLensVao );
+	mGlState.bindGlslProg( mGlslLens );
+	mGlState.bindSampler( 0, mLensSampler );
+
+	// each lens samples the region submitted for its eye: half of a double-wide frame and/or a scaled viewport
+	GLuint leftTexture = mFrameIsDoubleWide ? mDoubleWideTarget->getResolveTexture() : mEyeTargets[vr::Eye_Left]->getResolveTexture();
+	GLuint rightTexture = mFrameIsDoubleWide ? mDoubleWideTarget->getResolveTexture() : mEyeTargets[vr::Eye_Right]->getResolveTexture();
+	vr::VRTextureBounds_t bounds[2];
+	getSubmitBounds( bounds );
 
 	//render left lens (first half of index array )
-	glBindTexture( GL_TEXTURE_2D, leftEyeDesc.m_nResolveTextureId );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+	glUniform2f( mLensUvScaleLocation, bounds[vr::Eye_Left].uMax - bounds[vr::Eye_Left].uMin, bounds[vr::Eye_Left].vMax - bounds[vr::Eye_Left].vMin );
+	glUniform2f( mLensUvOffsetLocation, bounds[vr::Eye_Left].uMin, bounds[vr::Eye_Left].vMin );
+	mGlState.bindTexture( GL_TEXTURE_2D, leftTexture );
 	glDrawElements( GL_TRIANGLES, m_uiIndexSize / 2, GL_UNSIGNED_SHORT, 0 );
 
 	//render right lens (second half of index array )
-	glBindTexture( GL_TEXTURE_2D, rightEyeDesc.m_nResolveTextureId );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+	glUniform2f( mLensUvScaleLocation, bounds[vr::Eye_Right].uMax - bounds[vr::Eye_Right].uMin, bounds[vr::Eye_Right].vMax - bounds[vr::Eye_Right].vMin );
+	glUniform2f( mLensUvOffsetLocation, bounds[vr::Eye_Right].uMin, bounds[vr::Eye_Right].vMin );
+	// a double-wide frame is still bound, only the bounds differ
+	mGlState.bindTexture( GL_TEXTURE_2D, rightTexture );
 	glDrawElements( GL_TRIANGLES, m_uiIndexSize / 2, GL_UNSIGNED_SHORT, (const void *)(m_uiIndexSize) );
+	mGlState.bindSampler( 0, 0 );
+	mGlState.countCalls( 6 );
+}
 
-	glBindVertexArray( 0 );
-	glUseProgram( 0 );
+void HtcVive::setMirrorMode( MirrorMode mode, int interval )
+{
+	mMirrorMode = mode;
+	mMirrorInterval = std::max( interval, 1 );
+	mMirrorFrame = 0;
+	if( mMirrorInterval == 1 ) {
+		mMirrorFbo.reset();
+	}
+}
+
+void HtcVive::renderMirror( const ivec2& windowSize )
+{
+	if( mMirrorMode == MIRROR_OFF || windowSize.x <= 0 || windowSize.y <= 0 )
+		return;
+
+	if( mMirrorInterval == 1 ) {
+		renderMirrorContents( windowSize );
+		return;
+	}
+
+	if( ! mMirrorFbo || mMirrorFbo->getSize() != windowSize ) {
+		mMirrorFbo = gl::Fbo::create( windowSize.x, windowSize.y, gl::Fbo::Format().disableDepth() );
+		mMirrorFrame = 0;
+	}
+	if( mMirrorFrame++ % mMirrorInterval == 0 ) {
+		gl::ScopedFramebuffer scopedFbo{ mMirrorFbo };
+		gl::clear( Color::black() );
+		renderMirrorContents( windowSize );
+	}
+
+	FrameProfiler::ScopedStage stage{ mProfiler, FrameProfiler::STAGE_DISTORTION };
+	mGlState.viewport( ivec2( 0 ), windowSize );
+	drawMirrorQuad( mMirrorFbo->getColorTexture()->getId(), vec4( -1, -1, 1, 1 ), vec4( 0, 0, 1, 1 ) );
+}
+
+void HtcVive::renderMirrorContents( const ivec2 & windowSize )
+{
+	if( mMirrorMode == MIRROR_DISTORTED ) {
+		renderDistortion( windowSize );
+		return;
+	}
+
+	FrameProfiler::ScopedStage stage{ mProfiler, FrameProfiler::STAGE_DISTORTION };
+	mGlState.viewport( ivec2( 0 ), windowSize );
+
+	GLuint textures[2] = {
+		mFrameIsDoubleWide ? mDoubleWideTarget->getResolveTexture() : mEyeTargets[vr::Eye_Left]->getResolveTexture(),
+		mFrameIsDoubleWide ? mDoubleWideTarget->getResolveTexture() : mEyeTargets[vr::Eye_Right]->getResolveTexture()
+	};
+	vr::VRTextureBounds_t bounds[2];
+	getSubmitBounds( bounds );
+
+	// letterbox the eyes side by side at the aspect ratio they were rendered with
+	int numEyes = mMirrorMode == MIRROR_BOTH_EYES ? 2 : 1;
+	float eyesAspect = numEyes * float( mViewportSize.x ) / mViewportSize.y;
+	float windowAspect = float( windowSize.x ) / windowSize.y;
+	vec2 extent( std::min( 1.0f, eyesAspect / windowAspect ), std::min( 1.0f, windowAspect / eyesAspect ) );
+	float eyeWidth = 2.0f * extent.x / numEyes;
+	for( int eye = 0; eye < numEyes; ++eye ) {
+		float x = -extent.x + eye * eyeWidth;
+		const vr::VRTextureBounds_t & b = bounds[eye];
+		drawMirrorQuad( textures[eye], vec4( x, -extent.y, x + eyeWidth, extent.y ), vec4( b.uMin, b.vMin, b.uMax, b.vMax ) );
+	}
+}
+
+void HtcVive::drawMirrorQuad( GLuint texture, const vec4 & rect, const vec4 & uvRect )
+{
+	mGlState.enable( GL_DEPTH_TEST, false );
+	mGlState.bindVao( mLensVao );
+	mGlState.bindGlslProg( mGlslMirror );
+	mGlState.bindSampler( 0, mLensSampler );
+	mGlState.bindTexture( GL_TEXTURE_2D, texture );
+	glUniform4f( mMirrorRectLocation, rect.x, rect.y, rect.z, rect.w );
+	glUniform4f( mMirrorUvRectLocation, uvRect.x, uvRect.y, uvRect.z, uvRect.w );
+	glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+	mGlState.bindSampler( 0, 0 );
+	mGlState.countCalls( 3 );
 }
 
 glm::mat4 HtcVive::getHMDMatrixProjectionEye( vr::Hmd_Eye nEye )
@@ -625,16 +3695,33 @@ glm::mat4 HtcVive::getCurrentViewProjectionMatrix( vr::Hmd_Eye nEye )
 
 void HtcVive::updateHMDMatrixPose()
 {
-	vr::VRCompositor()->WaitGetPoses( mTrackedDevicePose.data(), vr::k_unMaxTrackedDeviceCount, NULL, 0 );
+	FrameProfiler::ScopedStage stage{ mProfiler, FrameProfiler::STAGE_POSES };
+
+	// the compositor thread does the waiting when pipelined, so this thread predicts the poses itself
+	if( mCompositorThread )
+		mHMD->GetDeviceToAbsoluteTrackingPose( vr::VRCompositor()->GetTrackingSpace(), getSecondsToPhotons(), mTrackedDevicePose.data(), vr::k_unMaxTrackedDeviceCount );
+	else
+		vr::VRCompositor()->WaitGetPoses( mTrackedDevicePose.data(), vr::k_unMaxTrackedDeviceCount, NULL, 0 );
+	LATENCY_MARK( markPosesReady() );
+	mDeviceMotion.time = getTrackingTime() + getSecondsToPhotons();
 
 	m_iValidPoseCount = 0;
-	m_strPoseClasses = "";
 	for( int nDevice = 0; nDevice < vr::k_unMaxTrackedDeviceCount; ++nDevice )
 	{
 		if( mTrackedDevicePose[nDevice].bPoseIsValid )
 		{
-			m_iValidPoseCount++;
 			mDevicePose[nDevice] = convertSteamVRMatrixToMat4( mTrackedDevicePose[nDevice].mDeviceToAbsoluteTracking );
+
+			const vr::HmdVector3_t & velocity = mTrackedDevicePose[nDevice].vVelocity;
+			const vr::HmdVector3_t & angularVelocity = mTrackedDevicePose[nDevice].vAngularVelocity;
+			DeviceMotion motion;
+			motion.position = glm::vec3( mDevicePose[nDevice][3] );
+			motion.orientation = glm::quat_cast( glm::mat3( mDevicePose[nDevice] ) );
+			motion.velocity = glm::vec3( velocity.v[0], velocity.v[1], velocity.v[2] );
+			motion.angularVelocity = glm::vec3( angularVelocity.v[0], angularVelocity.v[1], angularVelocity.v[2] );
+			motion.time = mDeviceMotion.time;
+			motion.valid = true;
+			mDeviceMotion.set( nDevice, motion );
 			if( m_rDevClassChar[nDevice] == 0 )
 			{
 				switch( mHMD->GetTrackedDeviceClass( nDevice ) )
@@ -647,48 +3734,164 @@ void HtcVive::updateHMDMatrixPose()
 				default:                                       m_rDevClassChar[nDevice] = '?'; break;
 				}
 			}
-			m_strPoseClasses += m_rDevClassChar[nDevice];
+			m_strPoseClasses[m_iValidPoseCount++] = m_rDevClassChar[nDevice];
+		}
+		else {
+			mDeviceMotion.valid[nDevice] = false;
 		}
 	}
 
+	m_strPoseClasses[m_iValidPoseCount] = 0;
+
+	mPoseHistory.publish( mDeviceMotion );
+
 	if( mTrackedDevicePose[vr::k_unTrackedDeviceIndex_Hmd].bPoseIsValid )
 	{
 		m_mat4HMDPose = glm::inverse( mDevicePose[vr::k_unTrackedDeviceIndex_Hmd] );
 	}
 }
 
-RenderModelRef HtcVive::findOrLoadRenderModel( const std::string& name )
+void HtcVive::writePoseUniforms( const glm::mat4 & hmdView, const std::array<glm::mat4, vr::k_unMaxTrackedDeviceCount> & devicePose )
 {
-	auto resIt = std::find_if( std::begin( mRenderModels ), std::end( mRenderModels ), [&]( const RenderModelRef& m ) {
-		return m->GetName() == name;
-	} );
+	const glm::mat4 eyePos[2] = { m_mat4eyePosLeft, m_mat4eyePosRight };
+	const glm::mat4 projection[2] = { m_mat4ProjectionLeft, m_mat4ProjectionRight };
+
+	EyeUniforms eyes[2];
+	StereoUniforms stereo;
+	for( int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye ) {
+		eyes[eye].viewMatrix = eyePos[eye] * hmdView;
+		eyes[eye].projectionMatrix = projection[eye];
+		eyes[eye].viewProjectionMatrix = projection[eye] * eyes[eye].viewMatrix;
+		std::copy( devicePose.begin(), devicePose.end(), eyes[eye].devicePose );
+
+		stereo.viewMatrix[eye] = eyes[eye].viewMatrix;
+		stereo.projectionMatrix[eye] = eyes[eye].projectionMatrix;
+		stereo.viewProjectionMatrix[eye] = eyes[eye].viewProjectionMatrix;
+	}
+	std::copy( devicePose.begin(), devicePose.end(), stereo.devicePose );
 
-	// load the model if we didn't find one
-	if( resIt == std::end( mRenderModels ) ) {
-		vr::RenderModel_t *pModel = NULL;
-		if( !vr::VRRenderModels()->LoadRenderModel( name.c_str(), &pModel ) || pModel == NULL ) {
-			CI_LOG_E( "Unable to load render model " << name );
-			return nullptr; // move on to the next tracked device
-		}
+	mPoseUniforms->write( eyes[vr::Eye_Left], eyes[vr::Eye_Right], stereo );
+}
 
-		vr::RenderModel_TextureMap_t *pTexture = NULL;
-		if( !vr::VRRenderModels()->LoadTexture( pModel->diffuseTextureId, &pTexture ) || pTexture == NULL ) {
-			CI_LOG_E( "Unable to load render texture id:%d for render model %s\n", pModel->diffuseTextureId, pchRenderModelName );
-			vr::VRRenderModels()->FreeRenderModel( pModel );
-			return nullptr; // move on to the next tracked device
+float HtcVive::getSecondsToPhotons() const
+{
+	// the photons of the upcoming vsync, which is what the compositor predicts WaitGetPoses for; the compositor thread
+	// submits the frame being rendered after the one it is working on, so pipelined frames reach the display one later
+	float secondsSinceLastVsync = 0;
+	mHMD->GetTimeSinceLastVsync( &secondsSinceLastVsync, NULL );
+	int framesAhead = mCompositorThread ? 2 : 1;
+	return framesAhead / mDisplayFrequency - secondsSinceLastVsync + mSecondsFromVsyncToPhotons;
+}
+
+void HtcVive::enableReprojection( bool enable )
+{
+	if( enable && mCompositorThread ) {
+		CI_LOG_W( "Reprojection needs direct submission and is not available with Options::pipelinedSubmit()." );
+		return;
+	}
+
+	mReprojection = enable;
+	mHasReprojectionHistory = false;
+	if( ! enable ) {
+		for( int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye ) {
+			mReprojectionHistory[eye].reset();
+			mReprojectionOutput[eye].reset();
 		}
+		return;
+	}
 
-		auto model = RenderModel::create( name, *pModel, *pTexture, mGlslModel );
-		mRenderModels.emplace_back( model );
+	// in the eye targets' format, so that reprojected frames are submitted in the same color space
+	auto format = gl::Fbo::Format().disableDepth().colorTexture( gl::Texture2d::Format().internalFormat( mOptions.getColorFormat() ) );
+	for( int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye ) {
+		mReprojectionHistory[eye] = gl::Fbo::create( mRenderSize.x, mRenderSize.y, format );
+		mReprojectionOutput[eye] = gl::Fbo::create( mRenderSize.x, mRenderSize.y, format );
+	}
+}
 
-		vr::VRRenderModels()->FreeRenderModel( pModel );
-		vr::VRRenderModels()->FreeTexture( pTexture );
+void HtcVive::captureReprojectionHistory( GLuint leftTexture, GLuint rightTexture, const vr::VRTextureBounds_t * bounds )
+{
+	// copied rather than referenced, since the next frame resolves into the same textures before it may be found late;
+	// sRGB contents are decoded when sampled, so they have to be encoded again when written
+	gl::ScopedState srgb( GL_FRAMEBUFFER_SRGB, true );
+	GLuint textures[2] = { leftTexture, rightTexture };
+	for( int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye ) {
+		mGlState.bindFramebuffer( GL_FRAMEBUFFER, mReprojectionHistory[eye]->getId() );
+		mGlState.viewport( ivec2( 0 ), ivec2( mRenderSize ) );
+		drawMirrorQuad( textures[eye], vec4( -1, -1, 1, 1 ), vec4( bounds[eye].uMin, bounds[eye].vMin, bounds[eye].uMax, bounds[eye].vMax ) );
+	}
+	mGlState.bindFramebuffer( GL_FRAMEBUFFER, 0 );
+	mReprojectionView = m_mat4HMDPose;
+	mHasReprojectionHistory = true;
+}
 
-		return model;
+void HtcVive::reprojectFrame()
+{
+	// with pipelined submission the compositor thread owns WaitGetPoses and Submit, and waiting here would deadlock it
+	if( mCompositorThread ) {
+		CI_LOG_W( "Reprojection needs direct submission and is not available with Options::pipelinedSubmit()." );
+		return;
 	}
-	return nullptr;
+	if( ! mReprojection || ! mHasReprojectionHistory ) {
+		// nothing to show yet; the compositor keeps reprojecting what it has
+		return;
+	}
+
+	updateHMDMatrixPose();
+	submitReprojectedFrame();
+}
+
+bool HtcVive::checkReprojectionWatchdog()
+{
+	// at most once per frame, between bind() and unbind(), and only with a previous frame to show instead
+	if( mFrameStartTime < 0.0 || mFrameReprojected || ! mReprojection || ! mHasReprojectionHistory || mReprojectionWatchdogMs <= 0.0 )
+		return false;
+	if( ( getTrackingTime() - mFrameStartTime ) * 1000.0 <= mReprojectionWatchdogMs )
+		return false;
+
+	// this frame's poses were predicted for the vsync it is about to miss, so they are the right ones to rotate to
+	submitReprojectedFrame();
+	mFrameReprojected = true;
+	return true;
 }
 
+void HtcVive::submitReprojectedFrame()
+{
+	// may interrupt an eye pass, so everything the warp changes is restored afterwards
+	gl::ScopedFramebuffer scopedFramebuffer( GL_FRAMEBUFFER, gl::context()->getFramebuffer() );
+	gl::ScopedViewport scopedViewport( ivec2( 0 ), ivec2( mRenderSize ) );
+	gl::ScopedVao scopedVao( mLensVao );
+	gl::ScopedGlslProg scopedGlsl( mGlslReproject );
+	gl::ScopedTextureBind scopedTexture( GL_TEXTURE_2D, 0, 0 );
+	gl::ScopedState scopedDepth( GL_DEPTH_TEST, false );
+	gl::ScopedState scopedScissor( GL_SCISSOR_TEST, false );
+	gl::ScopedState scopedStencil( GL_STENCIL_TEST, false );
+	gl::ScopedState scopedBlend( GL_BLEND, false );
+	gl::ScopedState scopedCulling( GL_CULL_FACE, false );
+	gl::ScopedState scopedSrgb( GL_FRAMEBUFFER_SRGB, true );
+
+	const mat4 eyePos[2] = { m_mat4eyePosLeft, m_mat4eyePosRight };
+	const mat4 projection[2] = { m_mat4ProjectionLeft, m_mat4ProjectionRight };
+	mGlState.bindSampler( 0, mLensSampler );
+	for( int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye ) {
+		// only the rotation between the old and the new eye is undone; translation would need the frame's depth
+		mat3 oldRotation = mat3( eyePos[eye] * mReprojectionView );
+		mat3 newRotation = mat3( eyePos[eye] * m_mat4HMDPose );
+		mat4 unproject = glm::inverse( projection[eye] );
+		mat4 reproject = projection[eye] * mat4( oldRotation * glm::transpose( newRotation ) );
+
+		mGlState.bindFramebuffer( GL_FRAMEBUFFER, mReprojectionOutput[eye]->getId() );
+		mGlState.bindTexture( GL_TEXTURE_2D, mReprojectionHistory[eye]->getColorTexture()->getId() );
+		glUniformMatrix4fv( mReprojectUnprojectLocation, 1, GL_FALSE, glm::value_ptr( unproject ) );
+		glUniformMatrix4fv( mReprojectReprojectLocation, 1, GL_FALSE, glm::value_ptr( reproject ) );
+		glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+		mGlState.countCalls( 3 );
+	}
+	mGlState.bindSampler( 0, 0 );
+
+	vr::VRTextureBounds_t bounds[2] = { { 0.0f, 0.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 1.0f } };
+	SubmitEyeTextures( vr::VRCompositor(), mReprojectionOutput[vr::Eye_Left]->getColorTexture()->getId(), mReprojectionOutput[vr::Eye_Right]->getColorTexture()->getId(), bounds, GetColorSpace( mOptions.getColorFormat() ) );
+	++mReprojectedFrames;
+}
 
 glm::mat4 HtcVive::convertSteamVRMatrixToMat4( const vr::HmdMatrix34_t &matPose )
 {
@@ -0,0 +1,86 @@
+#include "CinderVive.h"
+#include "StubRuntime.h"
+#include "Test.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace ci;
+using namespace hmd;
+
+namespace {
+
+// only allocations of the thread inside a ScopedAllocationCount are counted, the app's other threads are left alone
+thread_local bool sCounting = false;
+std::atomic<size_t> sAllocations( 0 );
+
+//! Counts the heap allocations made by the current thread during its scope.
+struct ScopedAllocationCount {
+	ScopedAllocationCount() : start( sAllocations.load() ) { sCounting = true; }
+	~ScopedAllocationCount() { sCounting = false; }
+
+	size_t get() const { return sAllocations.load() - start; }
+
+	size_t start;
+};
+
+void * countedAlloc( size_t size )
+{
+	if( sCounting )
+		++sAllocations;
+	if( void * ptr = std::malloc( size ? size : 1 ) )
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void renderPlainScene( vr::Hmd_Eye eye )
+{
+	gl::clear( eye == vr::Eye_Left ? Color( 1, 0, 0 ) : Color( 0, 0, 1 ) );
+}
+
+} // anonymous namespace
+
+void * operator new( size_t size ) { return countedAlloc( size ); }
+void * operator new[]( size_t size ) { return countedAlloc( size ); }
+void operator delete( void * ptr ) noexcept { std::free( ptr ); }
+void operator delete[]( void * ptr ) noexcept { std::free( ptr ); }
+void operator delete( void * ptr, size_t ) noexcept { std::free( ptr ); }
+void operator delete[]( void * ptr, size_t ) noexcept { std::free( ptr ); }
+
+TEST_CASE( steadyStateFramesDoNotAllocate )
+{
+	const int numWarmUpFrames = 4;
+	const int numFrames = 16;
+
+	auto vive = HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ).msaaSamples( 1 ) );
+	GpuInstanceCuller culler;
+	culler.setInstances( std::vector<vec4>( 64, vec4( 0, 0, -2, 0.5f ) ) );
+
+	// a capturing lambda larger than std::function's small buffer, which FunctionRef still must not copy
+	vec4 clearColor( 0, 1, 0, 1 );
+	mat4 padding[2];
+	auto renderScene = [clearColor, padding]( vr::Hmd_Eye eye ) {
+		gl::clear( ColorA( clearColor.x, clearColor.y, clearColor.z, padding[eye][0][0] ) );
+	};
+	auto renderFrame = [&]( int frame ) {
+		vive->update();
+		vive->bind();
+		culler.cull( vive->getCuller(), 1 );
+		if( frame % 2 )
+			vive->renderStereoTargets( renderScene );
+		else
+			vive->renderStereoTargets( renderPlainScene );
+		vive->unbind();
+		vive->renderDistortion( ivec2( 128 ) );
+	};
+
+	// the first frames size the per-frame containers and GL state stacks
+	for( int frame = 0; frame < numWarmUpFrames; ++frame )
+		renderFrame( frame );
+
+	ScopedAllocationCount allocations;
+	for( int frame = 0; frame < numFrames; ++frame )
+		renderFrame( frame );
+	CHECK( allocations.get() == 0 );
+}
@@ -0,0 +1,35 @@
+#include "CinderVive.h"
+#include "StubRuntime.h"
+#include "Test.h"
+
+using namespace ci;
+using namespace hmd;
+
+namespace {
+
+vr::EColorSpace submitFrame( const HtcVive::Options & options )
+{
+	stub::runtime().reset();
+	auto vive = HtcVive::create( options );
+	vive->update();
+	vive->bind();
+	vive->renderStereoTargets( []( vr::Hmd_Eye eye ) {
+		gl::clear( Color::white() );
+	} );
+	vive->unbind();
+
+	vr::EColorSpace left = stub::runtime().getLastSubmission( vr::Eye_Left ).colorSpace;
+	CHECK( stub::runtime().getLastSubmission( vr::Eye_Right ).colorSpace == left );
+	return left;
+}
+
+} // anonymous namespace
+
+TEST_CASE( colorSpaceFollowsTheEyeTargetFormat )
+{
+	auto options = HtcVive::Options().cacheDirectory( fs::path() ).msaaSamples( 1 );
+	CHECK( submitFrame( options ) == vr::ColorSpace_Gamma );
+	CHECK( submitFrame( options.colorFormat( GL_RGBA16F ) ) == vr::ColorSpace_Linear );
+	CHECK( submitFrame( options.colorFormat( GL_SRGB8_ALPHA8 ) ) == vr::ColorSpace_Auto );
+	CHECK( submitFrame( options.sharedEyeTarget().colorFormat( GL_RGBA16F ) ) == vr::ColorSpace_Linear );
+}
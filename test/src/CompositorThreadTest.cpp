@@ -0,0 +1,113 @@
+#include "CinderVive.h"
+#include "StubRuntime.h"
+#include "Test.h"
+
+using namespace ci;
+using namespace hmd;
+
+namespace {
+
+//! A frame whose "textures" are just ids telling the frames apart in the stub's submissions.
+CompositorThread::Frame makeFrame( int slot, int index )
+{
+	CompositorThread::Frame frame = { slot, GLuint( 100 + index ), GLuint( 200 + index ), { { 0, 0, 1, 1 }, { 0, 0, 1, 1 } }, vr::ColorSpace_Gamma, glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 ) };
+	glFlush();
+	return frame;
+}
+
+bool waitForSubmissions( int count, double timeoutSeconds )
+{
+	double start = stub::runtime().getTime();
+	while( stub::runtime().submitCalls < count ) {
+		if( stub::runtime().getTime() - start > timeoutSeconds )
+			return false;
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+	return true;
+}
+
+} // anonymous namespace
+
+TEST_CASE( submitReturnsWithoutWaitingForTheCompositor )
+{
+	// each Submit takes far longer than handing a frame over may
+	stub::runtime().submitDelay = 0.050;
+
+	CompositorThread thread( &stub::runtime(), gl::Context::create( gl::context() ), 2 );
+	for( int index = 0; index < 2; ++index ) {
+		int slot = thread.acquireSlot();
+		double start = stub::runtime().getTime();
+		thread.submit( makeFrame( slot, index ) );
+		CHECK( stub::runtime().getTime() - start < stub::runtime().submitDelay / 2 );
+	}
+
+	CHECK( waitForSubmissions( 4, 2.0 ) );
+	for( const auto & submission : stub::runtime().getSubmissions() )
+		CHECK( submission.thread != std::this_thread::get_id() );
+}
+
+TEST_CASE( renderThreadIsPacedToTheDisplayWithoutDroppingFrames )
+{
+	const int numFrames = 12;
+	stub::runtime().simulateVsync = true;
+
+	CompositorThread thread( &stub::runtime(), gl::Context::create( gl::context() ), 2 );
+	double start = stub::runtime().getTime();
+	for( int index = 0; index < numFrames; ++index ) {
+		int slot = thread.acquireSlot();
+		thread.submit( makeFrame( slot, index ) );
+	}
+	// the render thread runs at most a frame ahead of the compositor, which submits once per vsync
+	CHECK( stub::runtime().getTime() - start >= ( numFrames - 2 ) * stub::runtime().getFramePeriod() );
+
+	CHECK( waitForSubmissions( 2 * numFrames, 2.0 ) );
+	std::vector<stub::Submission> submissions = stub::runtime().getSubmissions();
+	CHECK( submissions.size() == 2 * numFrames );
+	for( int index = 0; index < numFrames && 2 * index + 1 < (int)submissions.size(); ++index ) {
+		CHECK( submissions[2 * index].eye == vr::Eye_Left && submissions[2 * index].texture == GLuint( 100 + index ) );
+		CHECK( submissions[2 * index + 1].eye == vr::Eye_Right && submissions[2 * index + 1].texture == GLuint( 200 + index ) );
+	}
+}
+
+TEST_CASE( pipelinedBindPredictsPosesInsteadOfWaiting )
+{
+	// a compositor that takes most of a frame to release poses would stall a render thread waiting for them
+	stub::runtime().simulateVsync = true;
+	stub::runtime().waitGetPosesDelay = 0.008;
+
+	auto vive = HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ).pipelinedSubmit() );
+	vive->update();
+	double start = stub::runtime().getTime();
+	vive->bind();
+	CHECK( stub::runtime().getTime() - start < stub::runtime().waitGetPosesDelay );
+
+	vive->renderStereoTargets( []( vr::Hmd_Eye eye ) {} );
+	vive->unbind();
+	for( int frame = 1; frame < 4; ++frame ) {
+		vive->update();
+		vive->bind();
+		vive->renderStereoTargets( []( vr::Hmd_Eye eye ) {} );
+		vive->unbind();
+	}
+
+	CHECK( waitForSubmissions( 2 * 4, 2.0 ) );
+	for( const auto & submission : stub::runtime().getSubmissions() )
+		CHECK( submission.thread != std::this_thread::get_id() );
+}
+
+TEST_CASE( shutdownDoesNotWaitForAnotherVsync )
+{
+	stub::runtime().simulateVsync = true;
+	stub::runtime().waitGetPosesDelay = 0.050;
+
+	double start;
+	{
+		CompositorThread thread( &stub::runtime(), gl::Context::create( gl::context() ), 2 );
+		thread.submit( makeFrame( thread.acquireSlot(), 0 ) );
+		CHECK( waitForSubmissions( 2, 2.0 ) );
+		start = stub::runtime().getTime();
+	}
+	// poses are only waited for once a frame is ready, so every wait is followed by its submit
+	CHECK( stub::runtime().getTime() - start < stub::runtime().waitGetPosesDelay );
+	CHECK( stub::runtime().waitGetPosesCalls == 1 );
+}
@@ -0,0 +1,39 @@
+#include "CinderVive.h"
+#include "Test.h"
+
+#include "cinder/Rand.h"
+
+using namespace ci;
+using namespace hmd;
+
+TEST_CASE( batchPredictionMatchesSingleDevicePrediction )
+{
+	Rand rand( 1 );
+	DeviceMotionBatch batch;
+	DeviceMotion motions[DeviceMotionBatch::SIZE];
+	for( uint32_t device = 0; device < DeviceMotionBatch::SIZE; ++device ) {
+		DeviceMotion & motion = motions[device];
+		motion.position = rand.randVec3() * rand.randFloat( 2.0f );
+		motion.orientation = glm::angleAxis( rand.randFloat( 6.0f ), rand.randVec3() );
+		motion.velocity = rand.randVec3() * rand.randFloat( 3.0f );
+		motion.angularVelocity = rand.randVec3() * rand.randFloat( 20.0f );
+		motion.time = 1.0;
+		// the invalid slots come out as identity
+		motion.valid = device % 5 != 4;
+		batch.set( device, motion );
+	}
+	batch.time = 1.0;
+
+	// up to 100 ms at 20 rad/s stays within the documented ~3 rad
+	for( double dt : { 0.0, 0.011, 0.05, 0.1 } ) {
+		glm::mat4 poses[DeviceMotionBatch::SIZE];
+		batch.predict( 1.0 + dt, poses );
+		for( uint32_t device = 0; device < DeviceMotionBatch::SIZE; ++device ) {
+			glm::mat4 expected = motions[device].valid ? motions[device].predict( 1.0 + dt ) : glm::mat4();
+			for( int col = 0; col < 4; ++col ) {
+				for( int row = 0; row < 4; ++row )
+					CHECK_NEAR( poses[device][col][row], expected[col][row], 1e-3 );
+			}
+		}
+	}
+}
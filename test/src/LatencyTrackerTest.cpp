@@ -0,0 +1,46 @@
+#include "CinderVive.h"
+#include "StubRuntime.h"
+#include "Test.h"
+
+#include <numeric>
+
+using namespace ci;
+using namespace hmd;
+
+TEST_CASE( poseAgeAccountsForTheTimeBetweenPosesAndSubmit )
+{
+	const int numFrames = 3;
+	const double renderDelay = 0.010;
+
+	// time spent waiting for poses is not part of their age, time spent rendering and submitting is
+	stub::runtime().waitGetPosesDelay = 0.050;
+	stub::runtime().submitDelay = 0.003;
+
+	auto vive = HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ) );
+	vive->getLatencyTracker().reset();
+	for( int frame = 0; frame < numFrames; ++frame ) {
+		vive->update();
+		vive->bind();
+		vive->renderStereoTargets( [&]( vr::Hmd_Eye eye ) {
+			if( eye == vr::Eye_Left )
+				std::this_thread::sleep_for( std::chrono::duration<double>( renderDelay ) );
+		} );
+		vive->unbind();
+	}
+
+	std::vector<LatencyTracker::Sample> samples;
+	vive->getLatencyTracker().getSamples( &samples );
+	CHECK( samples.size() == numFrames );
+	for( const auto & sample : samples ) {
+		CHECK( sample.eyeAgeMs[vr::Eye_Left] < stub::runtime().waitGetPosesDelay * 1000.0 );
+		CHECK( sample.eyeAgeMs[vr::Eye_Right] >= renderDelay * 1000.0 );
+		CHECK( sample.submitAgeMs >= ( renderDelay + 2 * stub::runtime().submitDelay ) * 1000.0 );
+		CHECK( sample.eyeTime[vr::Eye_Left] >= sample.posesTime );
+		CHECK( sample.submitTime >= sample.eyeTime[vr::Eye_Right] );
+	}
+
+	std::vector<uint32_t> histogram = vive->getLatencyTracker().getHistogram();
+	CHECK( histogram.size() == LatencyTracker::NUM_BINS );
+	CHECK( std::accumulate( histogram.begin(), histogram.end(), 0u ) == numFrames );
+	CHECK( vive->getLatencyTracker().getPercentileMs( 1.0 ) >= samples.back().submitAgeMs - LatencyTracker::getBinWidthMs() );
+}
@@ -0,0 +1,99 @@
+#include "CinderVive.h"
+#include "StubRuntime.h"
+#include "Test.h"
+
+using namespace ci;
+using namespace hmd;
+
+namespace {
+
+//! A lens that mirrors each eye's image horizontally, which the distorted output makes easy to recognize.
+vr::DistortionCoordinates_t mirrorLens( vr::Hmd_Eye eye, float u, float v )
+{
+	vr::DistortionCoordinates_t result = { { 1 - u, v }, { 1 - u, v }, { 1 - u, v } };
+	return result;
+}
+
+//! A fresh, empty cache directory that is removed again at the end of the scope.
+struct ScopedCacheDirectory {
+	ScopedCacheDirectory()
+		: path( fs::temp_directory_path() / ( "CinderViveTests-" + std::to_string( std::chrono::steady_clock::now().time_since_epoch().count() ) ) )
+	{
+		fs::remove_all( path );
+	}
+	~ScopedCacheDirectory()
+	{
+		fs::remove_all( path );
+	}
+
+	fs::path path;
+};
+
+} // anonymous namespace
+
+TEST_CASE( lensGridIsComputedOncePerVertexAcrossThreads )
+{
+	const ivec2 gridSize( 9, 7 );
+	auto vive = HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ).lensGridSize( gridSize ) );
+
+	CHECK( stub::runtime().distortionCalls == 2 * gridSize.x * gridSize.y );
+	if( std::thread::hardware_concurrency() > 1 ) {
+		CHECK( stub::runtime().getDistortionThreads().size() > 1 );
+	}
+}
+
+TEST_CASE( lensGridIsCachedPerHeadset )
+{
+	ScopedCacheDirectory cache;
+	auto options = HtcVive::Options().cacheDirectory( cache.path ).lensGridSize( ivec2( 11 ) );
+
+	HtcVive::create( options );
+	CHECK( stub::runtime().distortionCalls == 2 * 11 * 11 );
+
+	// the same headset loads the cached grid
+	stub::runtime().distortionCalls = 0;
+	HtcVive::create( options );
+	CHECK( stub::runtime().distortionCalls == 0 );
+
+	// another headset computes its own
+	stub::runtime().serialNumber = "STUB-0002";
+	HtcVive::create( options );
+	CHECK( stub::runtime().distortionCalls == 2 * 11 * 11 );
+}
+
+TEST_CASE( renderDistortionSamplesThroughTheLensMesh )
+{
+	stub::runtime().distortion = mirrorLens;
+	auto vive = HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ).msaaSamples( 1 ) );
+
+	// red on the left and blue on the right half of each eye
+	vive->update();
+	vive->bind();
+	vive->renderStereoTargets( []( vr::Hmd_Eye eye ) {
+		ivec2 origin = gl::getViewport().first;
+		ivec2 half( gl::getViewport().second.x / 2, gl::getViewport().second.y );
+		{
+			gl::ScopedScissor scissor( origin, half );
+			gl::clear( Color( 1, 0, 0 ) );
+		}
+		{
+			gl::ScopedScissor scissor( origin + ivec2( half.x, 0 ), half );
+			gl::clear( Color( 0, 0, 1 ) );
+		}
+	} );
+	vive->unbind();
+
+	auto fbo = gl::Fbo::create( 128, 64, gl::Fbo::Format().samples( 0 ) );
+	{
+		gl::ScopedFramebuffer scopedFbo( fbo );
+		gl::clear( Color::black() );
+		vive->renderDistortion( fbo->getSize() );
+	}
+
+	// each lens shows its eye mirrored
+	test::Image image = test::readTexture( fbo->getColorTexture()->getId() );
+	CHECK( test::isColor( image, 16, 32, 0, 0, 255 ) );
+	CHECK( test::isColor( image, 48, 32, 255, 0, 0 ) );
+	CHECK( test::isColor( image, 80, 32, 0, 0, 255 ) );
+	CHECK( test::isColor( image, 112, 32, 255, 0, 0 ) );
+}
@@ -0,0 +1,48 @@
+#include "CinderVive.h"
+#include "StubRuntime.h"
+#include "Test.h"
+
+using namespace ci;
+using namespace hmd;
+
+TEST_CASE( failedSetupShutsTheRuntimeDown )
+{
+	// a depth format cannot be a color attachment, so the eye targets are incomplete
+	bool thrown = false;
+	try {
+		HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ).colorFormat( GL_DEPTH_COMPONENT24 ) );
+	}
+	catch( const ViveExeption & ) {
+		thrown = true;
+	}
+	CHECK( thrown );
+	CHECK( stub::runtime().initCalls == 1 );
+	CHECK( stub::runtime().shutdownCalls == 1 );
+}
+
+TEST_CASE( targetCreatedMidSessionKeepsCinderBindings )
+{
+	auto vive = HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ) );
+	auto fbo = gl::Fbo::create( 32, 32 );
+	auto texture = gl::Texture2d::create( 4, 4 );
+
+	gl::ScopedFramebuffer scopedFbo( fbo );
+	gl::ScopedTextureBind scopedTexture( texture );
+	vive->enableFixedFoveation();
+
+	// Cinder's cached bindings still match GL's, so its next bind is not skipped
+	GLint framebuffer = 0, boundTexture = 0;
+	glGetIntegerv( GL_FRAMEBUFFER_BINDING, &framebuffer );
+	glGetIntegerv( GL_TEXTURE_BINDING_2D, &boundTexture );
+	CHECK( GLuint( framebuffer ) == fbo->getId() );
+	CHECK( GLuint( framebuffer ) == gl::context()->getFramebuffer() );
+	CHECK( GLuint( boundTexture ) == texture->getId() );
+	CHECK( GLuint( boundTexture ) == gl::context()->getTextureBinding( GL_TEXTURE_2D, 0 ) );
+}
+
+TEST_CASE( foveationStaysOffWithASharedEyeTarget )
+{
+	auto vive = HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ).sharedEyeTarget() );
+	vive->enableFixedFoveation();
+	CHECK( ! vive->isFixedFoveationEnabled() );
+}
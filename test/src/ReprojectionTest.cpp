@@ -0,0 +1,146 @@
+#include "CinderVive.h"
+#include "StubRuntime.h"
+#include "Test.h"
+
+using namespace ci;
+using namespace hmd;
+
+namespace {
+
+const int GRID_CELLS = 4;
+
+//! Fills each eye with a GRID_CELLS x GRID_CELLS grid whose red and green tell the cells apart.
+void renderGrid( vr::Hmd_Eye eye )
+{
+	ivec2 origin = gl::getViewport().first;
+	ivec2 cell( gl::getViewport().second.x / GRID_CELLS, gl::getViewport().second.y / GRID_CELLS );
+	for( int j = 0; j < GRID_CELLS; ++j ) {
+		for( int i = 0; i < GRID_CELLS; ++i ) {
+			gl::ScopedScissor scissor( origin + ivec2( i, j ) * cell, cell );
+			gl::clear( Color( i / 3.0f, j / 3.0f, 0 ) );
+		}
+	}
+}
+
+void renderFrame( const HtcViveRef & vive, const std::function<void( vr::Hmd_Eye )> & render )
+{
+	vive->update();
+	vive->bind();
+	vive->renderStereoTargets( render );
+	vive->unbind();
+}
+
+glm::mat4 getStubProjection( vr::Hmd_Eye eye )
+{
+	vr::HmdMatrix44_t mat = stub::runtime().GetProjectionMatrix( eye, 0.1f, 100.0f, vr::API_OpenGL );
+	glm::mat4 result;
+	for( int row = 0; row < 4; ++row ) {
+		for( int col = 0; col < 4; ++col )
+			result[col][row] = mat.m[row][col];
+	}
+	return result;
+}
+
+} // anonymous namespace
+
+TEST_CASE( reprojectedFrameMatchesTheRotatedReference )
+{
+	auto vive = HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ).msaaSamples( 1 ) );
+	vive->enableReprojection();
+	renderFrame( vive, renderGrid );
+
+	// the head turns 5 degrees to the left while the next frame is missed
+	glm::mat4 rotation = glm::rotate( glm::radians( 5.0f ), vec3( 0, 1, 0 ) );
+	stub::runtime().setHmdPose( rotation );
+	vive->reprojectFrame();
+	CHECK( vive->getReprojectedFrameCount() == 1 );
+	CHECK( stub::runtime().submitCalls == 4 );
+
+	// each new pixel looks along its far plane direction, rotated back into the old eye; outside of it there is nothing to show
+	test::Image image = test::readTexture( stub::runtime().getLastSubmission( vr::Eye_Left ).texture );
+	glm::mat4 projection = getStubProjection( vr::Eye_Left );
+	glm::mat4 unproject = glm::inverse( projection );
+	int compared = 0, moved = 0;
+	for( int y = 0; y < image.height; ++y ) {
+		for( int x = 0; x < image.width; ++x ) {
+			vec2 ndc = ( vec2( x, y ) + 0.5f ) / vec2( image.width, image.height ) * 2.0f - 1.0f;
+			vec4 far = unproject * vec4( ndc, 1, 1 );
+			vec4 clip = projection * rotation * vec4( vec3( far ) / far.w, 1 );
+			vec2 uv = vec2( clip ) / clip.w * 0.5f + 0.5f;
+
+			// pixels within a texel and a half of a cell edge may filter either way
+			vec2 cell = uv * float( GRID_CELLS );
+			vec2 edge = glm::abs( cell - glm::floor( cell + 0.5f ) ) * vec2( image.width, image.height ) / float( GRID_CELLS );
+			if( clip.w <= 0 || edge.x < 1.5f || edge.y < 1.5f )
+				continue;
+
+			bool inside = uv.x > 0 && uv.x < 1 && uv.y > 0 && uv.y < 1;
+			ivec2 expected = inside ? ivec2( cell ) * 85 : ivec2( 0 );
+			CHECK( test::isColor( image, x, y, expected.x, expected.y, 0 ) );
+			++compared;
+			if( ivec2( ( ndc * 0.5f + 0.5f ) * float( GRID_CELLS ) ) != ivec2( cell ) || ! inside )
+				++moved;
+		}
+	}
+	CHECK( compared > image.width * image.height / 2 );
+	CHECK( moved > image.height );
+}
+
+TEST_CASE( watchdogReplacesTheLateFrameBeforeItFinishes )
+{
+	auto vive = HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ).msaaSamples( 1 ) );
+	vive->enableReprojection();
+	vive->setReprojectionWatchdog( 5.0 );
+	renderFrame( vive, renderGrid );
+	CHECK( vive->getReprojectedFrameCount() == 0 );
+
+	// the left eye overruns the watchdog, so the reprojected frame is submitted before the right eye is rendered
+	int submitCallsBeforeRight = -1;
+	vive->update();
+	vive->bind();
+	vive->renderStereoTargets( [&]( vr::Hmd_Eye eye ) {
+		if( eye == vr::Eye_Left )
+			std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+		else
+			submitCallsBeforeRight = stub::runtime().submitCalls;
+		renderGrid( eye );
+	} );
+	CHECK( submitCallsBeforeRight == 4 );
+	CHECK( vive->getReprojectedFrameCount() == 1 );
+
+	// the late frame is kept for the next reprojection but not submitted on top
+	vive->unbind();
+	CHECK( stub::runtime().submitCalls == 4 );
+	CHECK( vive->getFreshFrameCount() == 1 );
+	CHECK( vive->getReprojectedFrameCount() == 1 );
+
+	// the next frame in time is submitted as usual
+	renderFrame( vive, renderGrid );
+	CHECK( stub::runtime().submitCalls == 6 );
+	CHECK( vive->getFreshFrameCount() == 2 );
+}
+
+TEST_CASE( reprojectFrameWithoutHistoryDoesNotWait )
+{
+	auto vive = HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ) );
+	vive->enableReprojection();
+	int waitGetPosesCalls = stub::runtime().waitGetPosesCalls;
+	vive->reprojectFrame();
+	CHECK( stub::runtime().waitGetPosesCalls == waitGetPosesCalls );
+	CHECK( stub::runtime().submitCalls == 0 );
+	CHECK( vive->getReprojectedFrameCount() == 0 );
+}
+
+TEST_CASE( reprojectFrameRefusesPipelinedSubmission )
+{
+	stub::runtime().waitGetPosesDelay = 0.050;
+	auto vive = HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ).pipelinedSubmit() );
+	vive->enableReprojection();
+	CHECK( ! vive->isReprojectionEnabled() );
+
+	double start = stub::runtime().getTime();
+	vive->reprojectFrame();
+	CHECK( stub::runtime().getTime() - start < stub::runtime().waitGetPosesDelay );
+	CHECK( stub::runtime().submitCalls == 0 );
+	CHECK( vive->getReprojectedFrameCount() == 0 );
+}
@@ -0,0 +1,89 @@
+#include "CinderVive.h"
+#include "StubRuntime.h"
+#include "Test.h"
+
+using namespace ci;
+using namespace hmd;
+
+namespace {
+
+// a wall in front of both eyes, red where the left eye sees it and green for the right
+const char * WALL_VERT =
+	"in vec4 ciPosition;\n"
+	"flat out int vEye;\n"
+	"void main()\n"
+	"{\n"
+	"	vEye = viveStereoEye();\n"
+	"	gl_Position = viveStereoClipPosition( ciPosition );\n"
+	"}\n";
+
+const char * WALL_FRAG =
+	"#version 410 core\n"
+	"flat in int vEye;\n"
+	"out vec4 oColor;\n"
+	"void main()\n"
+	"{\n"
+	"	oColor = vEye == 0 ? vec4( 1, 0, 0, 1 ) : vec4( 0, 1, 0, 1 );\n"
+	"}\n";
+
+} // anonymous namespace
+
+TEST_CASE( singlePassRendersBothEyesInOneCallback )
+{
+	auto vive = HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ) );
+	auto glsl = gl::GlslProg::create( gl::GlslProg::Format().vertex( HtcVive::getSinglePassShaderPreamble() + WALL_VERT ).fragment( WALL_FRAG ) );
+	glsl->uniformBlock( "ViveStereo", HtcVive::STEREO_UNIFORM_BINDING );
+	auto wall = gl::Batch::create( geom::Rect( Rectf( -10, -10, 10, 10 ) ) >> geom::Translate( vec3( 0, 0, -2 ) ), glsl );
+
+	int calls = 0;
+	vive->update();
+	vive->bind();
+	vive->renderStereoTargetsSinglePass( [&] {
+		++calls;
+		gl::clear( Color::black() );
+		wall->drawInstanced( 2 );
+	} );
+	vive->unbind();
+
+	CHECK( calls == 1 );
+
+	// both eyes are submitted as halves of one double-wide texture
+	stub::Submission left = stub::runtime().getLastSubmission( vr::Eye_Left );
+	stub::Submission right = stub::runtime().getLastSubmission( vr::Eye_Right );
+	CHECK( left.texture != 0 );
+	CHECK( left.texture == right.texture );
+	CHECK_NEAR( left.bounds.uMin, 0.0, 1e-6 );
+	CHECK_NEAR( left.bounds.uMax, 0.5, 1e-6 );
+	CHECK_NEAR( right.bounds.uMin, 0.5, 1e-6 );
+	CHECK_NEAR( right.bounds.uMax, 1.0, 1e-6 );
+
+	test::Image image = test::readTexture( left.texture );
+	CHECK( image.width == 2 * (int)stub::runtime().renderSize.x );
+	CHECK( test::isColor( image, image.width / 4, image.height / 2, 255, 0, 0 ) );
+	CHECK( test::isColor( image, 3 * image.width / 4, image.height / 2, 0, 255, 0 ) );
+}
+
+TEST_CASE( multiPassStillRendersEachEyeSeparately )
+{
+	auto vive = HtcVive::create( HtcVive::Options().cacheDirectory( fs::path() ) );
+
+	std::vector<vr::Hmd_Eye> eyes;
+	vive->update();
+	vive->bind();
+	vive->renderStereoTargets( [&]( vr::Hmd_Eye eye ) {
+		eyes.push_back( eye );
+		gl::clear( eye == vr::Eye_Left ? Color( 1, 0, 0 ) : Color( 0, 1, 0 ) );
+	} );
+	vive->unbind();
+
+	CHECK( eyes.size() == 2 );
+	CHECK( eyes[0] == vr::Eye_Left && eyes[1] == vr::Eye_Right );
+
+	stub::Submission left = stub::runtime().getLastSubmission( vr::Eye_Left );
+	stub::Submission right = stub::runtime().getLastSubmission( vr::Eye_Right );
+	CHECK( left.texture != right.texture );
+	test::Image leftImage = test::readTexture( left.texture );
+	test::Image rightImage = test::readTexture( right.texture );
+	CHECK( test::isColor( leftImage, leftImage.width / 2, leftImage.height / 2, 255, 0, 0 ) );
+	CHECK( test::isColor( rightImage, rightImage.width / 2, rightImage.height / 2, 0, 255, 0 ) );
+}
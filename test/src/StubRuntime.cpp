@@ -0,0 +1,342 @@
+#include "StubRuntime.h"
+
+#include "cinder/Matrix.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace stub;
+
+namespace {
+
+vr::HmdMatrix34_t toHmdMatrix34( const glm::mat4 & m )
+{
+	vr::HmdMatrix34_t result;
+	for( int row = 0; row < 3; ++row ) {
+		for( int col = 0; col < 4; ++col )
+			result.m[row][col] = m[col][row];
+	}
+	return result;
+}
+
+uint32_t copyString( const std::string & value, char * buffer, uint32_t bufferSize, vr::ETrackedPropertyError * error )
+{
+	uint32_t length = (uint32_t)value.size() + 1;
+	if( error )
+		*error = bufferSize < length ? vr::TrackedProp_BufferTooSmall : vr::TrackedProp_Success;
+	if( buffer && bufferSize >= length )
+		memcpy( buffer, value.c_str(), length );
+	return length;
+}
+
+} // anonymous namespace
+
+const size_t Runtime::SUBMISSION_CAPACITY;
+
+Runtime::Runtime()
+{
+	reset();
+}
+
+void Runtime::reset()
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mEpoch = std::chrono::steady_clock::now();
+	mHmdPose = glm::mat4();
+	mNumSubmissions = 0;
+	mDistortionThreads.clear();
+
+	renderSize = glm::uvec2( 64, 64 );
+	displayFrequency = 90.0f;
+	secondsFromVsyncToPhotons = 0.011f;
+	ipd = 0.064f;
+	serialNumber = "STUB-0001";
+	driverVersion = "1.0.0";
+	distortion = nullptr;
+	simulateVsync = false;
+	waitGetPosesDelay = 0.0;
+	submitDelay = 0.0;
+	distortionCalls = 0;
+	waitGetPosesCalls = 0;
+	submitCalls = 0;
+	initCalls = 0;
+	shutdownCalls = 0;
+}
+
+double Runtime::getTime() const
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now() - mEpoch ).count();
+}
+
+void Runtime::setHmdPose( const glm::mat4 & deviceToTracking )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	mHmdPose = deviceToTracking;
+}
+
+glm::mat4 Runtime::getHmdPose() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mHmdPose;
+}
+
+std::vector<Submission> Runtime::getSubmissions() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	std::vector<Submission> result;
+	size_t first = mNumSubmissions > SUBMISSION_CAPACITY ? mNumSubmissions - SUBMISSION_CAPACITY : 0;
+	for( size_t i = first; i < mNumSubmissions; ++i )
+		result.push_back( mSubmissions[i % SUBMISSION_CAPACITY] );
+	return result;
+}
+
+Submission Runtime::getLastSubmission( vr::Hmd_Eye eye ) const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	size_t first = mNumSubmissions > SUBMISSION_CAPACITY ? mNumSubmissions - SUBMISSION_CAPACITY : 0;
+	for( size_t i = mNumSubmissions; i > first; --i ) {
+		if( mSubmissions[( i - 1 ) % SUBMISSION_CAPACITY].eye == eye )
+			return mSubmissions[( i - 1 ) % SUBMISSION_CAPACITY];
+	}
+	return Submission{ eye, 0, vr::VRTextureBounds_t{ 0, 0, 0, 0 }, vr::ColorSpace_Auto, -1.0, std::thread::id() };
+}
+
+std::set<std::thread::id> Runtime::getDistortionThreads() const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	return mDistortionThreads;
+}
+
+void Runtime::fillPoses( vr::TrackedDevicePose_t * poses, uint32_t count ) const
+{
+	glm::mat4 hmdPose = getHmdPose();
+	for( uint32_t i = 0; i < count; ++i ) {
+		vr::TrackedDevicePose_t & pose = poses[i];
+		memset( &pose, 0, sizeof( pose ) );
+		pose.mDeviceToAbsoluteTracking = toHmdMatrix34( i == vr::k_unTrackedDeviceIndex_Hmd ? hmdPose : glm::mat4() );
+		pose.eTrackingResult = i == vr::k_unTrackedDeviceIndex_Hmd ? vr::TrackingResult_Running_OK : vr::TrackingResult_Uninitialized;
+		pose.bPoseIsValid = i == vr::k_unTrackedDeviceIndex_Hmd;
+		pose.bDeviceIsConnected = i == vr::k_unTrackedDeviceIndex_Hmd;
+	}
+}
+
+void Runtime::sleepFor( double seconds )
+{
+	if( seconds > 0.0 )
+		std::this_thread::sleep_for( std::chrono::duration<double>( seconds ) );
+}
+
+void Runtime::GetRecommendedRenderTargetSize( uint32_t * pnWidth, uint32_t * pnHeight )
+{
+	*pnWidth = renderSize.x;
+	*pnHeight = renderSize.y;
+}
+
+vr::HmdMatrix44_t Runtime::GetProjectionMatrix( vr::Hmd_Eye eEye, float fNearZ, float fFarZ, vr::EGraphicsAPIConvention eProjType )
+{
+	glm::mat4 projection = glm::perspective( glm::radians( 90.0f ), float( renderSize.x ) / float( renderSize.y ), fNearZ, fFarZ );
+	vr::HmdMatrix44_t result;
+	for( int row = 0; row < 4; ++row ) {
+		for( int col = 0; col < 4; ++col )
+			result.m[row][col] = projection[col][row];
+	}
+	return result;
+}
+
+vr::DistortionCoordinates_t Runtime::ComputeDistortion( vr::Hmd_Eye eEye, float fU, float fV )
+{
+	++distortionCalls;
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mDistortionThreads.insert( std::this_thread::get_id() );
+	}
+	if( distortion )
+		return distortion( eEye, fU, fV );
+
+	vr::DistortionCoordinates_t result = { { fU, fV }, { fU, fV }, { fU, fV } };
+	return result;
+}
+
+vr::HmdMatrix34_t Runtime::GetEyeToHeadTransform( vr::Hmd_Eye eEye )
+{
+	float x = ( eEye == vr::Eye_Left ? -0.5f : 0.5f ) * ipd;
+	return toHmdMatrix34( glm::translate( glm::mat4(), glm::vec3( x, 0, 0 ) ) );
+}
+
+bool Runtime::GetTimeSinceLastVsync( float * pfSecondsSinceLastVsync, uint64_t * pulFrameCounter )
+{
+	double time = getTime();
+	double period = getFramePeriod();
+	*pfSecondsSinceLastVsync = float( std::fmod( time, period ) );
+	if( pulFrameCounter )
+		*pulFrameCounter = uint64_t( time / period );
+	return true;
+}
+
+void Runtime::GetDeviceToAbsoluteTrackingPose( vr::ETrackingUniverseOrigin eOrigin, float fPredictedSecondsToPhotonsFromNow, vr::TrackedDevicePose_t * pTrackedDevicePoseArray, uint32_t unTrackedDevicePoseArrayCount )
+{
+	fillPoses( pTrackedDevicePoseArray, unTrackedDevicePoseArrayCount );
+}
+
+vr::ETrackedDeviceClass Runtime::GetTrackedDeviceClass( vr::TrackedDeviceIndex_t unDeviceIndex )
+{
+	return unDeviceIndex == vr::k_unTrackedDeviceIndex_Hmd ? vr::TrackedDeviceClass_HMD : vr::TrackedDeviceClass_Invalid;
+}
+
+bool Runtime::IsTrackedDeviceConnected( vr::TrackedDeviceIndex_t unDeviceIndex )
+{
+	return unDeviceIndex == vr::k_unTrackedDeviceIndex_Hmd;
+}
+
+float Runtime::GetFloatTrackedDeviceProperty( vr::TrackedDeviceIndex_t unDeviceIndex, vr::ETrackedDeviceProperty prop, vr::ETrackedPropertyError * pError )
+{
+	if( pError )
+		*pError = vr::TrackedProp_Success;
+	switch( prop ) {
+	case vr::Prop_DisplayFrequency_Float:			return displayFrequency;
+	case vr::Prop_SecondsFromVsyncToPhotons_Float:	return secondsFromVsyncToPhotons;
+	default:
+		if( pError )
+			*pError = vr::TrackedProp_UnknownProperty;
+		return 0.0f;
+	}
+}
+
+uint32_t Runtime::GetStringTrackedDeviceProperty( vr::TrackedDeviceIndex_t unDeviceIndex, vr::ETrackedDeviceProperty prop, char * pchValue, uint32_t unBufferSize, vr::ETrackedPropertyError * pError )
+{
+	if( unDeviceIndex != vr::k_unTrackedDeviceIndex_Hmd ) {
+		if( pError )
+			*pError = vr::TrackedProp_UnknownProperty;
+		return 0;
+	}
+
+	switch( prop ) {
+	case vr::Prop_TrackingSystemName_String:	return copyString( "stub", pchValue, unBufferSize, pError );
+	case vr::Prop_SerialNumber_String:			return copyString( serialNumber, pchValue, unBufferSize, pError );
+	case vr::Prop_DriverVersion_String:			return copyString( driverVersion, pchValue, unBufferSize, pError );
+	default:
+		if( pError )
+			*pError = vr::TrackedProp_UnknownProperty;
+		return 0;
+	}
+}
+
+bool Runtime::PollNextEvent( vr::VREvent_t * pEvent )
+{
+	return false;
+}
+
+vr::HiddenAreaMesh_t Runtime::GetHiddenAreaMesh( vr::Hmd_Eye eEye )
+{
+	vr::HiddenAreaMesh_t mesh = { nullptr, 0 };
+	return mesh;
+}
+
+bool Runtime::GetControllerState( vr::TrackedDeviceIndex_t unControllerDeviceIndex, vr::VRControllerState_t * pControllerState )
+{
+	return false;
+}
+
+bool Runtime::IsInputFocusCapturedByAnotherProcess()
+{
+	return false;
+}
+
+vr::EVRCompositorError Runtime::WaitGetPoses( vr::TrackedDevicePose_t * pRenderPoseArray, uint32_t unRenderPoseArrayCount, vr::TrackedDevicePose_t * pGamePoseArray, uint32_t unGamePoseArrayCount )
+{
+	++waitGetPosesCalls;
+	if( simulateVsync ) {
+		double period = getFramePeriod();
+		sleepFor( ( std::floor( getTime() / period ) + 1.0 ) * period - getTime() );
+	}
+	sleepFor( waitGetPosesDelay );
+
+	if( pRenderPoseArray )
+		fillPoses( pRenderPoseArray, unRenderPoseArrayCount );
+	if( pGamePoseArray )
+		fillPoses( pGamePoseArray, unGamePoseArrayCount );
+	return vr::VRCompositorError_None;
+}
+
+vr::EVRCompositorError Runtime::Submit( vr::Hmd_Eye eEye, const vr::Texture_t * pTexture, const vr::VRTextureBounds_t * pBounds, vr::EVRSubmitFlags nSubmitFlags )
+{
+	sleepFor( submitDelay );
+	++submitCalls;
+
+	Submission submission;
+	submission.eye = eEye;
+	submission.texture = (GLuint)(uintptr_t)pTexture->handle;
+	submission.bounds = pBounds ? *pBounds : vr::VRTextureBounds_t{ 0, 0, 1, 1 };
+	submission.colorSpace = pTexture->eColorSpace;
+	submission.time = getTime();
+	submission.thread = std::this_thread::get_id();
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	mSubmissions[mNumSubmissions++ % SUBMISSION_CAPACITY] = submission;
+	return vr::VRCompositorError_None;
+}
+
+vr::ETrackingUniverseOrigin Runtime::GetTrackingSpace()
+{
+	return vr::TrackingUniverseStanding;
+}
+
+bool Runtime::LoadRenderModel( const char * pchRenderModelName, vr::RenderModel_t ** ppRenderModel )
+{
+	return false;
+}
+
+void Runtime::FreeRenderModel( vr::RenderModel_t * pRenderModel )
+{
+}
+
+bool Runtime::LoadTexture( vr::TextureID_t textureId, vr::RenderModel_TextureMap_t ** ppTexture )
+{
+	return false;
+}
+
+void Runtime::FreeTexture( vr::RenderModel_TextureMap_t * pTexture )
+{
+}
+
+Runtime & stub::runtime()
+{
+	static Runtime instance;
+	return instance;
+}
+
+namespace vr {
+
+IVRSystem * VR_Init( EVRInitError * peError, EVRApplicationType eApplicationType )
+{
+	*peError = VRInitError_None;
+	++stub::runtime().initCalls;
+	return &stub::runtime();
+}
+
+void VR_Shutdown()
+{
+	++stub::runtime().shutdownCalls;
+}
+
+void * VR_GetGenericInterface( const char * pchInterfaceVersion, EVRInitError * peError )
+{
+	if( strcmp( pchInterfaceVersion, IVRRenderModels_Version ) == 0 ) {
+		*peError = VRInitError_None;
+		return static_cast<IVRRenderModels *>( &stub::runtime() );
+	}
+	*peError = VRInitError_Init_InterfaceNotFound;
+	return nullptr;
+}
+
+const char * VR_GetVRInitErrorAsEnglishDescription( EVRInitError error )
+{
+	return error == VRInitError_None ? "No error" : "Interface not found";
+}
+
+IVRCompositor * VRCompositor()
+{
+	return &stub::runtime();
+}
+
+} // namespace vr
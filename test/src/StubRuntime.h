@@ -0,0 +1,111 @@
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "openvr.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace stub {
+	//! One Submit() as seen by the compositor.
+	struct Submission {
+		vr::Hmd_Eye				eye;
+		GLuint					texture;
+		vr::VRTextureBounds_t	bounds;
+		vr::EColorSpace			colorSpace;
+		double					time;
+		std::thread::id			thread;
+	};
+
+	//! Stand-in for the SteamVR runtime: a headset at device 0 without controllers or render models, whose pose,
+	//! timing and lens distortion the tests control. vr::VR_Init(), vr::VRCompositor() and
+	//! vr::VR_GetGenericInterface() all return the one instance, which is reset before every test.
+	class Runtime : public vr::IVRSystem, public vr::IVRCompositor, public vr::IVRRenderModels {
+	public:
+		static const size_t SUBMISSION_CAPACITY = 64;
+
+		Runtime();
+		void reset();
+
+		//! Seconds since the last reset(), the clock of the simulated vsyncs.
+		double getTime() const;
+		double getFramePeriod() const { return 1.0 / displayFrequency; }
+
+		void setHmdPose( const glm::mat4 & deviceToTracking );
+		glm::mat4 getHmdPose() const;
+
+		//! Copies the submissions since reset(), oldest first; only the last SUBMISSION_CAPACITY are kept.
+		std::vector<Submission> getSubmissions() const;
+		Submission getLastSubmission( vr::Hmd_Eye eye ) const;
+		std::set<std::thread::id> getDistortionThreads() const;
+
+		glm::uvec2		renderSize;
+		float			displayFrequency;
+		float			secondsFromVsyncToPhotons;
+		float			ipd;
+		std::string		serialNumber;
+		std::string		driverVersion;
+		//! Analytic lens distortion returned by ComputeDistortion(), the identity unless set.
+		std::function<vr::DistortionCoordinates_t( vr::Hmd_Eye, float, float )> distortion;
+
+		//! WaitGetPoses() blocks until the next vsync, one getFramePeriod() after the previous, as the compositor does.
+		bool			simulateVsync;
+		//! Extra seconds spent in WaitGetPoses() and in each Submit().
+		double			waitGetPosesDelay;
+		double			submitDelay;
+
+		std::atomic<int>	distortionCalls;
+		std::atomic<int>	waitGetPosesCalls;
+		std::atomic<int>	submitCalls;
+		//! vr::VR_Init() and vr::VR_Shutdown() calls, which have to balance once every HtcVive is gone.
+		std::atomic<int>	initCalls;
+		std::atomic<int>	shutdownCalls;
+
+		// vr::IVRSystem
+		void GetRecommendedRenderTargetSize( uint32_t * pnWidth, uint32_t * pnHeight ) override;
+		vr::HmdMatrix44_t GetProjectionMatrix( vr::Hmd_Eye eEye, float fNearZ, float fFarZ, vr::EGraphicsAPIConvention eProjType ) override;
+		vr::DistortionCoordinates_t ComputeDistortion( vr::Hmd_Eye eEye, float fU, float fV ) override;
+		vr::HmdMatrix34_t GetEyeToHeadTransform( vr::Hmd_Eye eEye ) override;
+		bool GetTimeSinceLastVsync( float * pfSecondsSinceLastVsync, uint64_t * pulFrameCounter ) override;
+		void GetDeviceToAbsoluteTrackingPose( vr::ETrackingUniverseOrigin eOrigin, float fPredictedSecondsToPhotonsFromNow, vr::TrackedDevicePose_t * pTrackedDevicePoseArray, uint32_t unTrackedDevicePoseArrayCount ) override;
+		vr::ETrackedDeviceClass GetTrackedDeviceClass( vr::TrackedDeviceIndex_t unDeviceIndex ) override;
+		bool IsTrackedDeviceConnected( vr::TrackedDeviceIndex_t unDeviceIndex ) override;
+		float GetFloatTrackedDeviceProperty( vr::TrackedDeviceIndex_t unDeviceIndex, vr::ETrackedDeviceProperty prop, vr::ETrackedPropertyError * pError ) override;
+		uint32_t GetStringTrackedDeviceProperty( vr::TrackedDeviceIndex_t unDeviceIndex, vr::ETrackedDeviceProperty prop, char * pchValue, uint32_t unBufferSize, vr::ETrackedPropertyError * pError ) override;
+		bool PollNextEvent( vr::VREvent_t * pEvent ) override;
+		vr::HiddenAreaMesh_t GetHiddenAreaMesh( vr::Hmd_Eye eEye ) override;
+		bool GetControllerState( vr::TrackedDeviceIndex_t unControllerDeviceIndex, vr::VRControllerState_t * pControllerState ) override;
+		bool IsInputFocusCapturedByAnotherProcess() override;
+
+		// vr::IVRCompositor
+		vr::EVRCompositorError WaitGetPoses( vr::TrackedDevicePose_t * pRenderPoseArray, uint32_t unRenderPoseArrayCount, vr::TrackedDevicePose_t * pGamePoseArray, uint32_t unGamePoseArrayCount ) override;
+		vr::EVRCompositorError Submit( vr::Hmd_Eye eEye, const vr::Texture_t * pTexture, const vr::VRTextureBounds_t * pBounds, vr::EVRSubmitFlags nSubmitFlags ) override;
+		vr::ETrackingUniverseOrigin GetTrackingSpace() override;
+
+		// vr::IVRRenderModels
+		bool LoadRenderModel( const char * pchRenderModelName, vr::RenderModel_t ** ppRenderModel ) override;
+		void FreeRenderModel( vr::RenderModel_t * pRenderModel ) override;
+		bool LoadTexture( vr::TextureID_t textureId, vr::RenderModel_TextureMap_t ** ppTexture ) override;
+		void FreeTexture( vr::RenderModel_TextureMap_t * pTexture ) override;
+
+	private:
+		void fillPoses( vr::TrackedDevicePose_t * poses, uint32_t count ) const;
+		static void sleepFor( double seconds );
+
+		std::chrono::steady_clock::time_point	mEpoch;
+		mutable std::mutex						mMutex;
+		glm::mat4								mHmdPose;
+		std::array<Submission, SUBMISSION_CAPACITY> mSubmissions;
+		size_t									mNumSubmissions;
+		std::set<std::thread::id>				mDistortionThreads;
+	};
+
+	Runtime & runtime();
+}
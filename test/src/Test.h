@@ -0,0 +1,88 @@
+#pragma once
+
+#include "cinder/gl/gl.h"
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//! Minimal test registry for the Cinder-Vive tests, which all run inside one Cinder app for its GL context.
+namespace test {
+	typedef void ( *TestFn )();
+
+	struct TestCase {
+		const char *	name;
+		TestFn			fn;
+	};
+
+	inline std::vector<TestCase> & getTestCases()
+	{
+		static std::vector<TestCase> cases;
+		return cases;
+	}
+
+	struct Registrar {
+		Registrar( const char * name, TestFn fn ) { getTestCases().push_back( TestCase{ name, fn } ); }
+	};
+
+	struct Failure : public std::runtime_error {
+		Failure( const std::string & message ) : std::runtime_error( message ) {}
+	};
+
+	inline void fail( const char * file, int line, const std::string & message )
+	{
+		std::stringstream text;
+		text << file << ":" << line << ": " << message;
+		throw Failure( text.str() );
+	}
+
+	//! RGBA8 pixels, bottom row first.
+	struct Image {
+		int						width;
+		int						height;
+		std::vector<uint8_t>	pixels;
+
+		const uint8_t * at( int x, int y ) const { return &pixels[4 * ( y * width + x )]; }
+	};
+
+	//! Reads back level 0 of the 2D texture \a texture.
+	inline Image readTexture( GLuint texture )
+	{
+		Image image;
+		glBindTexture( GL_TEXTURE_2D, texture );
+		glGetTexLevelParameteriv( GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &image.width );
+		glGetTexLevelParameteriv( GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &image.height );
+		image.pixels.resize( 4 * image.width * image.height );
+		glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+		glGetTexImage( GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data() );
+		glBindTexture( GL_TEXTURE_2D, 0 );
+		return image;
+	}
+
+	//! Whether the pixel at \a x, \a y of \a image is within \a tolerance of \a r, \a g, \a b in every channel.
+	inline bool isColor( const Image & image, int x, int y, int r, int g, int b, int tolerance = 2 )
+	{
+		const uint8_t * p = image.at( x, y );
+		return std::abs( p[0] - r ) <= tolerance && std::abs( p[1] - g ) <= tolerance && std::abs( p[2] - b ) <= tolerance;
+	}
+}
+
+#define TEST_CASE( name ) \
+	static void name(); \
+	static test::Registrar name##Registrar( #name, &name ); \
+	static void name()
+
+#define CHECK( expr ) \
+	do { if( ! ( expr ) ) test::fail( __FILE__, __LINE__, "CHECK( " #expr " ) failed" ); } while( false )
+
+#define CHECK_NEAR( a, b, epsilon ) \
+	do { \
+		double checkA = ( a ), checkB = ( b ); \
+		if( ! ( std::abs( checkA - checkB ) <= ( epsilon ) ) ) { \
+			std::stringstream checkText; \
+			checkText << "CHECK_NEAR( " #a ", " #b " ) failed: " << checkA << " vs " << checkB; \
+			test::fail( __FILE__, __LINE__, checkText.str() ); \
+		} \
+	} while( false )
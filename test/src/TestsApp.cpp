@@ -0,0 +1,43 @@
+#include "cinder/app/App.h"
+#include "cinder/app/RendererGl.h"
+
+#include "StubRuntime.h"
+#include "Test.h"
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace ci;
+using namespace ci::app;
+
+//! Runs every registered test once the window's GL context exists, then exits with the number of failures.
+class TestsApp : public App {
+public:
+	void setup() override;
+};
+
+void TestsApp::setup()
+{
+	int failures = 0;
+	for( const auto & testCase : test::getTestCases() ) {
+		stub::runtime().reset();
+		try {
+			testCase.fn();
+			std::cout << "[ PASS ] " << testCase.name << std::endl;
+		}
+		catch( const std::exception & exc ) {
+			std::cout << "[ FAIL ] " << testCase.name << ": " << exc.what() << std::endl;
+			++failures;
+		}
+	}
+	std::cout << test::getTestCases().size() - failures << " of " << test::getTestCases().size() << " tests passed" << std::endl;
+	std::exit( failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE );
+}
+
+void prepareSettings( App::Settings * settings )
+{
+	settings->setWindowSize( 128, 128 );
+}
+
+// the library needs GL 4.1 at least; the tests also cover the 4.3+ paths when the driver (e.g. llvmpipe) offers them
+CINDER_APP( TestsApp, RendererGl( RendererGl::Options().version( 4, 5 ).msaa( 0 ) ), prepareSettings )
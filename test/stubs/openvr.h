@@ -0,0 +1,149 @@
+#pragma once
+
+// The part of the OpenVR API that Cinder-Vive uses, with the names and signatures of openvr/headers/openvr.h.
+// The tests compile the library against this header and link StubRuntime.cpp in place of openvr_api, so they
+// run without SteamVR or a headset.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vr {
+	static const uint32_t k_unMaxTrackedDeviceCount = 16;
+	static const uint32_t k_unTrackedDeviceIndex_Hmd = 0;
+	static const uint32_t k_unTrackedDeviceIndexInvalid = 0xFFFFFFFF;
+	static const uint32_t k_unMaxPropertyStringSize = 32 * 1024;
+
+	typedef uint32_t TrackedDeviceIndex_t;
+	typedef int32_t TextureID_t;
+
+	struct HmdMatrix34_t { float m[3][4]; };
+	struct HmdMatrix44_t { float m[4][4]; };
+	struct HmdVector3_t { float v[3]; };
+	struct HmdVector2_t { float v[2]; };
+
+	enum Hmd_Eye { Eye_Left = 0, Eye_Right = 1 };
+	enum EGraphicsAPIConvention { API_DirectX = 0, API_OpenGL = 1 };
+	enum EColorSpace { ColorSpace_Auto = 0, ColorSpace_Gamma = 1, ColorSpace_Linear = 2 };
+
+	struct Texture_t {
+		void *					handle;
+		EGraphicsAPIConvention	eType;
+		EColorSpace				eColorSpace;
+	};
+
+	struct VRTextureBounds_t { float uMin, vMin; float uMax, vMax; };
+	enum EVRSubmitFlags { Submit_Default = 0, Submit_LensDistortionAlreadyApplied = 1, Submit_GlRenderBuffer = 2 };
+
+	enum ETrackingResult { TrackingResult_Uninitialized = 1, TrackingResult_Running_OK = 200 };
+	struct TrackedDevicePose_t {
+		HmdMatrix34_t	mDeviceToAbsoluteTracking;
+		HmdVector3_t	vVelocity;
+		HmdVector3_t	vAngularVelocity;
+		ETrackingResult	eTrackingResult;
+		bool			bPoseIsValid;
+		bool			bDeviceIsConnected;
+	};
+
+	enum ETrackingUniverseOrigin { TrackingUniverseSeated = 0, TrackingUniverseStanding = 1, TrackingUniverseRawAndUncalibrated = 2 };
+	enum ETrackedDeviceClass {
+		TrackedDeviceClass_Invalid = 0,
+		TrackedDeviceClass_HMD = 1,
+		TrackedDeviceClass_Controller = 2,
+		TrackedDeviceClass_TrackingReference = 4,
+		TrackedDeviceClass_Other = 1000
+	};
+	enum ETrackedDeviceProperty {
+		Prop_TrackingSystemName_String = 1000,
+		Prop_ModelNumber_String = 1001,
+		Prop_SerialNumber_String = 1002,
+		Prop_RenderModelName_String = 1003,
+		Prop_DriverVersion_String = 1031,
+		Prop_SecondsFromVsyncToPhotons_Float = 2001,
+		Prop_DisplayFrequency_Float = 2002
+	};
+	typedef ETrackedDeviceProperty TrackedDeviceProperty;
+	enum ETrackedPropertyError { TrackedProp_Success = 0, TrackedProp_UnknownProperty = 6, TrackedProp_BufferTooSmall = 8 };
+	typedef ETrackedPropertyError TrackedPropertyError;
+
+	struct DistortionCoordinates_t { float rfRed[2]; float rfGreen[2]; float rfBlue[2]; };
+	struct HiddenAreaMesh_t { const HmdVector2_t * pVertexData; uint32_t unTriangleCount; };
+
+	struct VRControllerAxis_t { float x, y; };
+	struct VRControllerState001_t {
+		uint32_t			unPacketNum;
+		uint64_t			ulButtonPressed;
+		uint64_t			ulButtonTouched;
+		VRControllerAxis_t	rAxis[5];
+	};
+	typedef VRControllerState001_t VRControllerState_t;
+
+	enum EVREventType { VREvent_None = 0, VREvent_TrackedDeviceActivated = 100, VREvent_TrackedDeviceDeactivated = 101, VREvent_TrackedDeviceUpdated = 102 };
+	struct VREvent_Data_t { char reserved[64]; };
+	struct VREvent_t {
+		uint32_t				eventType;
+		TrackedDeviceIndex_t	trackedDeviceIndex;
+		float					eventAgeSeconds;
+		VREvent_Data_t			data;
+	};
+
+	enum EVRInitError { VRInitError_None = 0, VRInitError_Init_InterfaceNotFound = 105 };
+	enum EVRApplicationType { VRApplication_Other = 0, VRApplication_Scene = 1 };
+	enum EVRCompositorError { VRCompositorError_None = 0, VRCompositorError_DoNotHaveFocus = 101 };
+
+	class IVRSystem {
+	public:
+		virtual void GetRecommendedRenderTargetSize( uint32_t * pnWidth, uint32_t * pnHeight ) = 0;
+		virtual HmdMatrix44_t GetProjectionMatrix( Hmd_Eye eEye, float fNearZ, float fFarZ, EGraphicsAPIConvention eProjType ) = 0;
+		virtual DistortionCoordinates_t ComputeDistortion( Hmd_Eye eEye, float fU, float fV ) = 0;
+		virtual HmdMatrix34_t GetEyeToHeadTransform( Hmd_Eye eEye ) = 0;
+		virtual bool GetTimeSinceLastVsync( float * pfSecondsSinceLastVsync, uint64_t * pulFrameCounter ) = 0;
+		virtual void GetDeviceToAbsoluteTrackingPose( ETrackingUniverseOrigin eOrigin, float fPredictedSecondsToPhotonsFromNow, TrackedDevicePose_t * pTrackedDevicePoseArray, uint32_t unTrackedDevicePoseArrayCount ) = 0;
+		virtual ETrackedDeviceClass GetTrackedDeviceClass( TrackedDeviceIndex_t unDeviceIndex ) = 0;
+		virtual bool IsTrackedDeviceConnected( TrackedDeviceIndex_t unDeviceIndex ) = 0;
+		virtual float GetFloatTrackedDeviceProperty( TrackedDeviceIndex_t unDeviceIndex, ETrackedDeviceProperty prop, ETrackedPropertyError * pError = 0L ) = 0;
+		virtual uint32_t GetStringTrackedDeviceProperty( TrackedDeviceIndex_t unDeviceIndex, ETrackedDeviceProperty prop, char * pchValue, uint32_t unBufferSize, ETrackedPropertyError * pError = 0L ) = 0;
+		virtual bool PollNextEvent( VREvent_t * pEvent ) = 0;
+		virtual HiddenAreaMesh_t GetHiddenAreaMesh( Hmd_Eye eEye ) = 0;
+		virtual bool GetControllerState( TrackedDeviceIndex_t unControllerDeviceIndex, VRControllerState_t * pControllerState ) = 0;
+		virtual bool IsInputFocusCapturedByAnotherProcess() = 0;
+	};
+
+	class IVRCompositor {
+	public:
+		virtual EVRCompositorError WaitGetPoses( TrackedDevicePose_t * pRenderPoseArray, uint32_t unRenderPoseArrayCount, TrackedDevicePose_t * pGamePoseArray, uint32_t unGamePoseArrayCount ) = 0;
+		virtual EVRCompositorError Submit( Hmd_Eye eEye, const Texture_t * pTexture, const VRTextureBounds_t * pBounds = 0, EVRSubmitFlags nSubmitFlags = Submit_Default ) = 0;
+		virtual ETrackingUniverseOrigin GetTrackingSpace() = 0;
+	};
+
+	struct RenderModel_Vertex_t {
+		HmdVector3_t	vPosition;
+		HmdVector3_t	vNormal;
+		float			rfTextureCoord[2];
+	};
+	struct RenderModel_TextureMap_t {
+		uint16_t		unWidth, unHeight;
+		const uint8_t *	rubTextureMapData;
+	};
+	struct RenderModel_t {
+		const RenderModel_Vertex_t *	rVertexData;
+		uint32_t						unVertexCount;
+		const uint16_t *				rIndexData;
+		uint32_t						unTriangleCount;
+		TextureID_t						diffuseTextureId;
+	};
+
+	class IVRRenderModels {
+	public:
+		virtual bool LoadRenderModel( const char * pchRenderModelName, RenderModel_t ** ppRenderModel ) = 0;
+		virtual void FreeRenderModel( RenderModel_t * pRenderModel ) = 0;
+		virtual bool LoadTexture( TextureID_t textureId, RenderModel_TextureMap_t ** ppTexture ) = 0;
+		virtual void FreeTexture( RenderModel_TextureMap_t * pTexture ) = 0;
+	};
+	static const char * const IVRRenderModels_Version = "IVRRenderModels_002";
+
+	IVRSystem * VR_Init( EVRInitError * peError, EVRApplicationType eApplicationType );
+	void VR_Shutdown();
+	void * VR_GetGenericInterface( const char * pchInterfaceVersion, EVRInitError * peError );
+	const char * VR_GetVRInitErrorAsEnglishDescription( EVRInitError error );
+	IVRCompositor * VRCompositor();
+}